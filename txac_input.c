@@ -18,6 +18,21 @@ Compilar:
 #include <pthread.h>
 #include <immintrin.h>
 
+#if defined(_WIN32)
+    #include <windows.h>
+    #include <psapi.h>
+    #include <io.h>
+    #define popen  _popen
+    #define pclose _pclose
+    #define POPEN_READ "rb"             // pipe em modo binário: o WAV não pode passar por CRLF
+#else
+    #include <sys/resource.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define POPEN_READ "r"
+#endif
+
 // Retorna a distância (dist) se encontrar o valor, ou -1 se não encontrar na janela
 int find_next_match_avx2(const int32_t *deltas, int start, int limit, int32_t target) {
     // Carrega o valor alvo em todas as 8 posições do registrador AVX
@@ -51,11 +66,102 @@ int find_next_match_avx2(const int32_t *deltas, int start, int limit, int32_t ta
     return -1;
 }
 
+// Mesma busca com registradores de 16 posições; o resto sai numa carga
+// mascarada, sem loop escalar. Compilada só para esta função (o resto do
+// arquivo continua -mavx2) e escolhida em tempo de execução.
+__attribute__((target("avx512f")))
+int find_next_match_avx512(const int32_t *deltas, int start, int limit, int32_t target) {
+    __m512i target_vec = _mm512_set1_epi32(target);
+
+    int i = start;
+    for (; i <= limit - 16; i += 16) {
+        __mmask16 mask = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(&deltas[i]), target_vec);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    if (i <= limit) {
+        __mmask16 tail = (__mmask16)((1u << (limit - i + 1)) - 1);
+        __mmask16 mask = _mm512_mask_cmpeq_epi32_mask(tail, _mm512_maskz_loadu_epi32(tail, &deltas[i]), target_vec);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    return -1;
+}
+
+// Varredura usada pelo localizador de matches (main troca para AVX-512 se a CPU tiver)
+static int (*find_next_match)(const int32_t *, int, int, int32_t) = find_next_match_avx2;
+
+// Comprimento da run que começa em x[i] (>= 1): compara 8 valores por vez
+// com o primeiro e para no primeiro diferente. Silêncio e DC longos viram
+// uma run por bloco, então este laço é o que mais anda nesses trechos.
+size_t run_length_avx2(const int32_t *x, size_t i, size_t n) {
+    __m256i v = _mm256_set1_epi32(x[i]);
+    size_t j = i + 1;
+    for (; j + 8 <= n; j += 8) {
+        __m256i cmp = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)&x[j]), v);
+        unsigned diff = ~(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(cmp)) & 0xFF;
+        if (diff) return j + __builtin_ctz(diff) - i;
+    }
+    while (j < n && x[j] == x[i]) j++;
+    return j - i;
+}
+
+// Mesma contagem com 16 valores por comparação e o resto numa carga mascarada
+__attribute__((target("avx512f")))
+size_t run_length_avx512(const int32_t *x, size_t i, size_t n) {
+    __m512i v = _mm512_set1_epi32(x[i]);
+    size_t j = i + 1;
+    for (; j + 16 <= n; j += 16) {
+        __mmask16 diff = _mm512_cmpneq_epi32_mask(_mm512_loadu_si512(&x[j]), v);
+        if (diff) return j + __builtin_ctz(diff) - i;
+    }
+    if (j < n) {
+        __mmask16 tail = (__mmask16)((1u << (n - j)) - 1);
+        __mmask16 diff = _mm512_mask_cmpneq_epi32_mask(tail, _mm512_maskz_loadu_epi32(tail, &x[j]), v);
+        if (diff) return j + __builtin_ctz(diff) - i;
+    }
+    return n - i;
+}
+
+static size_t (*run_length_simd)(const int32_t *, size_t, size_t) = run_length_avx2;
+
+// Em música quase toda run tem 1 valor: esse caso sai aqui, sem a chamada
+static inline size_t run_length(const int32_t *x, size_t i, size_t n) {
+    if (i + 1 >= n || x[i + 1] != x[i]) return 1;
+    return run_length_simd(x, i, n);
+}
+
 #define TXAC_MAGIC "TXAC"
-#define TXAC_VERSION 4
+#define TXAC_VERSION 5
 #define DB_REDUCTION 110.0
 #define MAX_CHANNELS 32
 #define GROWTH_FACTOR 2
+#define DEFAULT_BLOCK_SIZE 4096   // amostras por bloco, por canal
+#define DEFAULT_MEMORY_MB 256     // orçamento da janela de leitura/compressão
+#define READ_BUFFER_BYTES (1 << 20) // leitura do WAV em pedaços de 1 MB
+#define WAVE_FORMAT_PCM        1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE  // o formato real vem nos 2 primeiros bytes do SubFormat
+#define TXAC_BLOCK_TOKENS 0       // tipo de bloco: fluxo de tokens em Rice(k) com o k do bloco
+#define TXAC_BLOCK_GROUPS 1       // tipo de bloco: tokens com grupos '(' (TXAC_FLAG_GROUPS)
+#define TXAC_BLOCK_CONSTANT 2     // tipo de bloco: um único valor int32, sem tokens
+#define TXAC_FLAG_BLOCK_PARAMS (1 << 3) // cada bloco traz o seu parâmetro Rice
+#define TXAC_FLAG_PREDICTOR (1 << 4)    // cada bloco traz o seu preditor
+#define TXAC_FLAG_LMS (1 << 5)          // cada bloco diz se passou pela cascata LMS
+#define TXAC_FLAG_STEREO (1 << 6)       // pares de canais acoplados, modo estéreo por bloco
+#define TXAC_FLAG_GROUPS (1 << 7)       // blocos TXAC_BLOCK_GROUPS: grupos '(' (cópia dentro do bloco)
+#define TXAC_FLAG_CONSTANT (1 << 8)     // blocos TXAC_BLOCK_CONSTANT (silêncio e DC)
+#define TXAC_FLAG_NATIVE (1 << 9)       // amostras inteiras na profundidade original, sem ganho
+#define TXAC_FLAG_WASTED (1 << 10)      // bit 6 do preditor: bits desperdiçados do bloco
+#define TXAC_FLAG_BINARY (1 << 2) // resíduos em Rice adaptativo, sem a camada de texto
+#define RESIDUAL_K0 4             // k inicial do Rice adaptativo em cada bloco
+#define RICE_ESCAPE_Q 24          // quociente a partir do qual o valor vai em binário puro
+#define RICE_MAX_K 3              // maior k dos símbolos de texto (4 bits por símbolo)
+#define GROUP_MIN_LEN 3           // menor grupo '(' codificável no modo binário
+#define K0_PROBE 16               // resíduos usados para estimar o k inicial no modo binário
+#define FIXED_MAX_ORDER 4         // maior ordem dos preditores polinomiais fixos
+#define LPC_MAX_ORDER 32          // maior ordem do LPC quantizado
+#define QLP_PRECISION 15          // bits (com sinal) dos coeficientes LPC quantizados
 
 const char simbolos[16] = {
     ',','-','1','2','3','4','5','6','7','8','9','0',
@@ -82,25 +188,141 @@ typedef struct {
     uint64_t total_samples;
 } TXACHeader;
 
+// Entrada da tabela de blocos (v5). Cada bloco começa com acumulador zerado,
+// então pode ser decodificado sozinho a partir de byte_offset.
+typedef struct {
+    uint64_t sample_index;  // primeira amostra do bloco dentro do canal
+    uint64_t byte_offset;   // posição absoluta no arquivo (relativa ao buffer do canal até a gravação)
+    uint32_t bit_size;      // tamanho do bloco em bits (header do bloco + Rice)
+    uint32_t sample_count;  // amostras no bloco (o último pode ser menor)
+} TXACBlockEntry;
+
+// Segmento = sequência de blocos consecutivos de um canal dentro da janela.
+// É a unidade de trabalho do pool; blocos não dependem uns dos outros.
 typedef struct {
     Channel *channel;
     Binary4BitBuffer *output;
+    TXACBlockEntry *blocks;
+    uint64_t first_sample;   // índice da primeira amostra da janela no canal
+    uint32_t first_block;    // primeiro bloco do segmento, relativo à janela
+    uint32_t block_size;
+    uint32_t block_count;    // blocos neste segmento
     int channel_id;
     int enable_loop_compression;
-} ThreadData;
+    int binary;
+    int best;                // --best: cascata LMS depois do preditor
+    const uint8_t *stereo_modes; // modo estéreo por bloco (NULL = fora da esquerda de um par)
+    int parse;               // PARSE_GREEDY ou PARSE_OPTIMAL (--parse)
+    int window;              // alcance do sniper em amostras (--window)
+    int groups;              // --groups: tokens de grupo '(' (TXAC_FLAG_GROUPS)
+    int verbose;
+    uint64_t sniper_lookups; // saída: contadores do localizador de matches
+    uint64_t sniper_found;
+    uint64_t sniper_used;
+    uint64_t group_tokens;   // saída: grupos emitidos e resíduos cobertos
+    uint64_t group_samples;
+    uint64_t constant_blocks; // saída: blocos TXAC_BLOCK_CONSTANT
+    uint64_t wasted_blocks;   // saída: blocos com bits desperdiçados
+} SegmentTask;
+
+// Arquivo inteiro mapeado só para leitura. Pipes, dispositivos e arquivos
+// vazios não mapeiam: quem chama continua no fread.
+typedef struct {
+    uint8_t *data;
+    uint64_t size;
+#if defined(_WIN32)
+    HANDLE mapping;
+#endif
+} MappedFile;
+
+static int map_file(FILE *f, MappedFile *m) {
+    memset(m, 0, sizeof(*m));
+#if defined(_WIN32)
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+    LARGE_INTEGER size;
+    if (h == INVALID_HANDLE_VALUE || GetFileType(h) != FILE_TYPE_DISK ||
+        !GetFileSizeEx(h, &size) || size.QuadPart <= 0) return 0;
+    m->mapping = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m->mapping) return 0;
+    m->data = (uint8_t*)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m->data) {
+        CloseHandle(m->mapping);
+        m->mapping = NULL;
+        return 0;
+    }
+    m->size = (uint64_t)size.QuadPart;
+#else
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return 0;
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (p == MAP_FAILED) return 0;
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+    m->data = (uint8_t*)p;
+    m->size = (uint64_t)st.st_size;
+#endif
+    return 1;
+}
+
+// Devolve ao sistema as páginas [from, to) já lidas: são páginas limpas do
+// arquivo, e sem isso o RSS cresceria até o tamanho do WAV. No Windows o
+// working set é aparado pelo próprio sistema.
+static void release_mapped(MappedFile *m, uint64_t from, uint64_t to) {
+#if !defined(_WIN32)
+    static uint64_t page = 0;
+    if (!page) page = (uint64_t)sysconf(_SC_PAGESIZE);
+    from = from / page * page;   // a página do início já foi lida pelo pedaço anterior
+    to   = to / page * page;     // a do fim ainda tem bytes do próximo
+    if (to > from) madvise(m->data + from, (size_t)(to - from), MADV_DONTNEED);
+#else
+    (void)m; (void)from; (void)to;
+#endif
+}
+
+static void unmap_file(MappedFile *m) {
+    if (!m->data) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(m->data);
+    CloseHandle(m->mapping);
+#else
+    munmap(m->data, (size_t)m->size);
+#endif
+    memset(m, 0, sizeof(*m));
+}
+
+// Estado da leitura em janelas: o WAV nunca fica inteiro na RAM
+typedef struct {
+    FILE *f;
+    int pipe;                 // f veio de popen (FFmpeg): fecha com pclose, sem mmap
+    uint16_t channels;
+    uint16_t bits_per_sample; // 16, 24 (packed) ou 32
+    int is_float;             // float32 IEEE em vez de inteiros
+    uint64_t data_remaining;  // bytes restantes do chunk 'data' (UINT64_MAX = até EOF)
+    float fator_f;
+    int native;               // --native: inteiros do arquivo como estão, sem fator_f
+    uint8_t *raw;             // READ_BUFFER_BYTES lidos do arquivo por vez (sem mmap)
+    int32_t *converted;       // as mesmas amostras já em int32, ainda intercaladas
+    MappedFile map;           // arquivo mapeado; map.data == NULL = fread
+    uint64_t map_pos;         // próximo byte de 'data' dentro do mapeamento
+} WavReader;
 
 typedef struct {
     Binary4BitBuffer *output;
     uint64_t bits;
     unsigned bit_count;
+    int binary;              // TXAC_FLAG_BINARY: tokens em Rice adaptativo
+    int groups;              // TXAC_BLOCK_GROUPS: s == 0 leva 1 bit (0 = run, 1 = grupo)
+    uint64_t mean16;         // média móvel dos resíduos zigzag, ×16 (modo binário)
+    // Modo texto: os símbolos do bloco ficam em espera até o k ser escolhido
+    Binary4BitBuffer *pending;
+    uint64_t histogram[16];
 } RiceBuffer;
 
 // ============================================================================
 // BUFFER + ESCRITA DIRETA DE SÍMBOLOS DE TEXTO EM RICE
 // ============================================================================
 
-void init_4bit_buffer(Binary4BitBuffer *buf) {
-    buf->capacity = 1024 * 1024;
+void init_4bit_buffer(Binary4BitBuffer *buf, size_t initial_capacity) {
+    buf->capacity = initial_capacity ? initial_capacity : 1024 * 1024;
     buf->byte_count = 0;
     buf->data = (uint8_t*)malloc(buf->capacity);
     if (!buf->data) {
@@ -133,24 +355,40 @@ static const uint8_t char_to_symbol[256] = {
     ['^'] = 13, ['~'] = 14, ['('] = 15, [')'] = 16
 };
 
-/* Códigos Rice(k=1) dos símbolos 0..15, alinhados à direita. */
-static const uint16_t rice_code[16] = {
-    0x000, 0x001, 0x004, 0x005, 0x00C, 0x00D, 0x01C, 0x01D,
-    0x03C, 0x03D, 0x07C, 0x07D, 0x0FC, 0x0FD, 0x1FC, 0x1FD
+/* Códigos Rice(k) dos símbolos 0..15 para k = 0..3, alinhados à direita. */
+static const uint16_t rice_code[RICE_MAX_K + 1][16] = {
+    { 0x0000, 0x0002, 0x0006, 0x000E, 0x001E, 0x003E, 0x007E, 0x00FE,
+      0x01FE, 0x03FE, 0x07FE, 0x0FFE, 0x1FFE, 0x3FFE, 0x7FFE, 0xFFFE },
+    { 0x0000, 0x0001, 0x0004, 0x0005, 0x000C, 0x000D, 0x001C, 0x001D,
+      0x003C, 0x003D, 0x007C, 0x007D, 0x00FC, 0x00FD, 0x01FC, 0x01FD },
+    { 0x0000, 0x0001, 0x0002, 0x0003, 0x0008, 0x0009, 0x000A, 0x000B,
+      0x0018, 0x0019, 0x001A, 0x001B, 0x0038, 0x0039, 0x003A, 0x003B },
+    { 0x0000, 0x0001, 0x0002, 0x0003, 0x0004, 0x0005, 0x0006, 0x0007,
+      0x0010, 0x0011, 0x0012, 0x0013, 0x0014, 0x0015, 0x0016, 0x0017 }
 };
-static const uint8_t rice_code_len[16] = {
-    2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9
+static const uint8_t rice_code_len[RICE_MAX_K + 1][16] = {
+    { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 },
+    { 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9 },
+    { 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6 },
+    { 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5 }
 };
 
-static inline void rice_writer_init(RiceBuffer *rb, Binary4BitBuffer *output) {
+static inline void rice_writer_init(RiceBuffer *rb, Binary4BitBuffer *output,
+                                    Binary4BitBuffer *pending, int binary, int groups) {
     rb->output = output;
     rb->bits = 0;
     rb->bit_count = 0;
+    rb->binary = binary;
+    rb->groups = groups;
+    rb->mean16 = (uint64_t)16 << RESIDUAL_K0;
+    rb->pending = pending;
+    if (pending) pending->byte_count = 0;
+    memset(rb->histogram, 0, sizeof(rb->histogram));
 }
 
-static inline void rice_write_symbol(RiceBuffer *rb, uint8_t symbol) {
-    unsigned len = rice_code_len[symbol];
-    rb->bits = (rb->bits << len) | rice_code[symbol];
+static inline void rice_write_symbol(RiceBuffer *rb, uint8_t symbol, unsigned k) {
+    unsigned len = rice_code_len[k][symbol];
+    rb->bits = (rb->bits << len) | rice_code[k][symbol];
     rb->bit_count += len;
 
     while (rb->bit_count >= 8) {
@@ -163,9 +401,32 @@ static inline void rice_write_symbol(RiceBuffer *rb, uint8_t symbol) {
     }
 }
 
+// Guarda o símbolo para rice_flush_symbols; o k só é escolhido no fim do bloco
 static inline void rice_write_char(RiceBuffer *rb, char c) {
     uint8_t encoded = char_to_symbol[(uint8_t)c];
-    if (encoded != 0) rice_write_symbol(rb, (uint8_t)(encoded - 1));
+    if (encoded == 0) return;
+    ensure_4bit_capacity(rb->pending, 1);
+    rb->pending->data[rb->pending->byte_count++] = (uint8_t)(encoded - 1);
+    rb->histogram[encoded - 1]++;
+}
+
+// Escolhe o k de menor custo exato para o histograma do bloco e escreve os
+// símbolos em espera com ele. Devolve o k, que vai no header do bloco.
+static unsigned rice_flush_symbols(RiceBuffer *rb) {
+    unsigned best_k = 1;
+    uint64_t best_bits = UINT64_MAX;
+    for (unsigned k = 0; k <= RICE_MAX_K; k++) {
+        uint64_t bits = 0;
+        for (int sym = 0; sym < 16; sym++)
+            bits += rb->histogram[sym] * rice_code_len[k][sym];
+        if (bits < best_bits) { best_bits = bits; best_k = k; }
+    }
+
+    const uint8_t *sym = rb->pending->data;
+    for (size_t i = 0; i < rb->pending->byte_count; i++)
+        rice_write_symbol(rb, sym[i], best_k);
+    rb->pending->byte_count = 0;
+    return best_k;
 }
 
 static void rice_write_u64(RiceBuffer *rb, uint64_t value) {
@@ -189,8 +450,123 @@ static void rice_write_i32(RiceBuffer *rb, int32_t value) {
     rice_write_u64(rb, magnitude);
 }
 
+// ============================================================================
+// MODO BINÁRIO (TXAC_FLAG_BINARY)
+// Cada token vira um código Rice de s com k adaptativo:
+//   s >= 2  → valor simples, zigzag(valor) = s - 2
+//   s == 0  → run '^':    Rice(zigzag(valor)) + Exp-Golomb(repetições - 2)
+//   s == 1  → sniper '~': Rice(zigzag(valor)) + Exp-Golomb(buraco)
+// Nos blocos TXAC_BLOCK_GROUPS o s == 0 é seguido de 1 bit: 0 = run e
+// 1 = grupo '(': Exp-Golomb(distância - 1) + Exp-Golomb(N - GROUP_MIN_LEN),
+// que copia os N resíduos que estavam 'distância' posições atrás (pode
+// sobrepor, como no LZ77). Valores simples não pagam nada; o grupo não mexe
+// na média móvel.
+// k sai da média móvel dos zigzag já codificados no bloco (o decoder refaz a
+// mesma conta), então não há dígito decimal nem divisão por 10.
+// ============================================================================
+
+static inline void rice_write_bits(RiceBuffer *rb, uint64_t value, unsigned len) {
+    while (len > 32) {                     // no máximo 32 por vez no acumulador
+        len -= 32;
+        rice_write_bits(rb, value >> len, 32);
+        value &= (UINT64_C(1) << len) - 1;
+    }
+    rb->bits = (rb->bits << len) | value;
+    rb->bit_count += len;
+
+    while (rb->bit_count >= 8) {
+        rb->bit_count -= 8;
+        ensure_4bit_capacity(rb->output, 1);
+        rb->output->data[rb->output->byte_count++] =
+            (uint8_t)(rb->bits >> rb->bit_count);
+        if (rb->bit_count == 0) rb->bits = 0;
+        else rb->bits &= (UINT64_C(1) << rb->bit_count) - 1;
+    }
+}
+
+static inline uint64_t zigzag32(int32_t v) {
+    return ((uint64_t)(uint32_t)v << 1) ^ ((uint64_t)(int64_t)(v >> 31) & UINT64_C(0x1FFFFFFFF));
+}
+
+static inline unsigned residual_k(uint64_t mean16) {
+    uint64_t avg = mean16 >> 4;
+    return avg ? 63 - (unsigned)__builtin_clzll(avg) : 0;
+}
+
+static inline void residual_update(RiceBuffer *rb, uint64_t z) {
+    rb->mean16 += z - (rb->mean16 >> 4);
+}
+
+// k inicial do bloco: média dos primeiros resíduos. deltas[0] é a amostra
+// absoluta que reinicia o acumulador, então fica de fora da estimativa.
+static unsigned estimate_initial_k(const int32_t *deltas, size_t n) {
+    uint64_t sum = 0;
+    size_t count = 0;
+    for (size_t i = 1; i < n && count < K0_PROBE; i++, count++)
+        sum += zigzag32(deltas[i]);
+    if (count == 0) return RESIDUAL_K0;
+    return residual_k(sum * 16 / count);
+}
+
+static void rice_write_adaptive(RiceBuffer *rb, uint64_t s, unsigned k) {
+    uint64_t q = s >> k;
+    if (q < RICE_ESCAPE_Q) {
+        rice_write_bits(rb, ((UINT64_C(1) << q) - 1) << 1, (unsigned)q + 1);
+        if (k) rice_write_bits(rb, s & ((UINT64_C(1) << k) - 1), k);
+    } else {
+        // Escape: RICE_ESCAPE_Q uns, 6 bits de comprimento e o valor cru
+        unsigned len = 64 - (unsigned)__builtin_clzll(s);
+        rice_write_bits(rb, (UINT64_C(1) << RICE_ESCAPE_Q) - 1, RICE_ESCAPE_Q);
+        rice_write_bits(rb, len, 6);
+        rice_write_bits(rb, s, len);
+    }
+}
+
+static inline void rice_write_expgolomb(RiceBuffer *rb, uint64_t n) {
+    uint64_t x = n + 1;
+    unsigned len = 64 - (unsigned)__builtin_clzll(x);
+    rice_write_bits(rb, 0, len - 1);
+    rice_write_bits(rb, x, len);
+}
+
+static void binary_write_token(RiceBuffer *rb, int32_t value,
+                               char operation, uint64_t argument) {
+    uint64_t z = zigzag32(value);
+    unsigned k = residual_k(rb->mean16);
+
+    if (operation == '(') {
+        rice_write_adaptive(rb, 0, k);
+        rice_write_bits(rb, 1, 1);
+        rice_write_expgolomb(rb, (uint32_t)value - 1);
+        rice_write_expgolomb(rb, argument - GROUP_MIN_LEN);
+        return;
+    }
+    if (operation == '\0') {
+        rice_write_adaptive(rb, z + 2, k);
+    } else {
+        rice_write_adaptive(rb, operation == '^' ? 0 : 1, k);
+        if (operation == '^' && rb->groups) rice_write_bits(rb, 0, 1);
+        rice_write_adaptive(rb, z, k);
+        rice_write_expgolomb(rb, operation == '^' ? argument - 2 : argument);
+    }
+    residual_update(rb, z);
+}
+
+// Grupo: operation '(', value = distância e argument = N; no texto "(D)N,"
 static inline void rice_write_token(RiceBuffer *rb, int32_t value,
                                     char operation, uint64_t argument) {
+    if (rb->binary) {
+        binary_write_token(rb, value, operation, argument);
+        return;
+    }
+    if (operation == '(') {
+        rice_write_char(rb, '(');
+        rice_write_u64(rb, (uint32_t)value);
+        rice_write_char(rb, ')');
+        rice_write_u64(rb, argument);
+        rice_write_char(rb, ',');
+        return;
+    }
     rice_write_i32(rb, value);
     if (operation != '\0') {
         rice_write_char(rb, operation);
@@ -239,39 +615,6 @@ void ensure_channel_capacity(Channel *ch, size_t required) {
     }
 }
 
-// ============================================================================
-// DELTA ENCODING
-// ============================================================================
-
-void apply_delta_encoding(Channel *ch, int32_t **deltas, size_t *delta_count) {
-    if (ch->count == 0) {
-        *deltas = NULL;
-        *delta_count = 0;
-        return;
-    }
-    
-    *delta_count = ch->count;
-    *deltas = (int32_t*)malloc(ch->count * sizeof(int32_t));
-    if (!*deltas) {
-        fprintf(stderr, "Error allocating delta buffer\n");
-        exit(1);
-    }
-    
-    // Primeiro valor é absoluto
-    (*deltas)[0] = ch->samples[0];
-    
-    // Demais valores são deltas (diferença entre consecutivos)
-    for (size_t i = 1; i < ch->count; i++) {
-        (*deltas)[i] = ch->samples[i] - ch->samples[i - 1];
-    }
-    
-    // Debug: mostra primeiros deltas
-    if (ch->count >= 10) {
-        printf("   First deltas: %d, %d, %d, %d, %d...\n", 
-               (*deltas)[0], (*deltas)[1], (*deltas)[2], (*deltas)[3], (*deltas)[4]);
-    }
-}
-
 // ============================================================================
 // LEITURA DE ÁUDIO
 // ============================================================================
@@ -285,220 +628,1713 @@ int precisa_converter(const char *filename) {
               ext[4] == '\0');
 }
 
-int convert_to_wav_temp(const char *audio_file, char *temp_wav) {
-    sprintf(temp_wav, "temp_txac_%d.wav", (int)time(NULL));
-    const char *ext = strrchr(audio_file, '.');
-    const char *formato = ext ? ext + 1 : "áudio";
-    
-    char cmd[2048];
-    sprintf(cmd, "ffmpeg -i \"%s\" -f wav -acodec pcm_s32le -rf64 never \"%s\" -y -loglevel error", 
-            audio_file, temp_wav);
-    
-    printf("Converting %s to WAV 32-bit...\n", formato);
-    if (system(cmd) != 0) {
-        fprintf(stderr, "Error converting FFmpeg\n");
+// Avança n bytes: fseek em arquivo comum, leitura descartada em pipe
+static int pular_bytes(FILE *f, uint64_t n) {
+    if (n == 0) return 1;
+    if (n < 0x7FFFFFFF && fseek(f, (long)n, SEEK_CUR) == 0) return 1;
+    uint8_t lixo[4096];
+    while (n > 0) {
+        size_t parte = n < sizeof(lixo) ? (size_t)n : sizeof(lixo);
+        if (fread(lixo, 1, parte, f) != parte) return 0;
+        n -= parte;
+    }
+    return 1;
+}
+
+static int fechar_entrada(FILE *f, int pipe) {
+    return pipe ? pclose(f) == 0 : fclose(f) == 0;
+}
+
+// Lê os chunks até 'data' e prepara a leitura em janelas. Em erro fecha f.
+static int iniciar_leitor_wav(FILE *f, int pipe, WavReader *wr, TXACHeader *header) {
+    // Os chunks são percorridos só para frente, sem voltar no arquivo,
+    // então o mesmo código lê de um pipe
+    // RF64/BW64 (arquivos acima de 4 GB) guardam os tamanhos de 64 bits no
+    // chunk 'ds64', e o chunk 'data' vem com 0xFFFFFFFF
+    uint8_t riff[12];
+    if (fread(riff, 1, 12, f) != 12 ||
+        (memcmp(riff, "RIFF", 4) != 0 && memcmp(riff, "RF64", 4) != 0 && memcmp(riff, "BW64", 4) != 0) ||
+        memcmp(riff + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "Error: Not a RIFF/WAVE file\n");
+        fechar_entrada(f, pipe);
+        return 0;
+    }
+    int rf64 = memcmp(riff, "RIFF", 4) != 0;
+
+    uint8_t chunk_id[4];
+    uint32_t chunk_size = 0;
+    uint64_t ds64_data_size = 0;
+    uint16_t format = 0;
+    int found = 0, have_fmt = 0;
+
+    while (fread(chunk_id, 1, 4, f) == 4 && fread(&chunk_size, 4, 1, f) == 1) {
+        if (memcmp(chunk_id, "data", 4) == 0) {
+            found = 1;
+            break;
+        }
+
+        uint64_t skip = (uint64_t)chunk_size + (chunk_size & 1);   // chunks ímpares têm 1 byte de padding
+        if (memcmp(chunk_id, "fmt ", 4) == 0 && chunk_size >= 16) {
+            // 16 bytes no PCM clássico, 18 no float, 40 no WAVE_FORMAT_EXTENSIBLE
+            uint8_t fmt[40];
+            size_t n = chunk_size < sizeof(fmt) ? chunk_size : sizeof(fmt);
+            if (fread(fmt, 1, n, f) != n) break;
+            memcpy(&format, fmt, 2);
+            memcpy(&header->channels, fmt + 2, 2);
+            memcpy(&header->sample_rate, fmt + 4, 4);
+            memcpy(&header->bits_per_sample, fmt + 14, 2);
+            if (format == WAVE_FORMAT_EXTENSIBLE && n >= 26) memcpy(&format, fmt + 24, 2);
+            have_fmt = 1;
+            skip -= n;
+        } else if (memcmp(chunk_id, "ds64", 4) == 0 && chunk_size >= 16) {
+            uint8_t ds64[16];   // riffSize, dataSize (o resto são tamanhos de outros chunks)
+            if (fread(ds64, 1, 16, f) != 16) break;
+            memcpy(&ds64_data_size, ds64 + 8, 8);
+            skip -= 16;
+        }
+        if (!pular_bytes(f, skip)) break;
+    }
+
+    if (!found || !have_fmt) {
+        fprintf(stderr, "Chunk '%s' not found\n", have_fmt ? "data" : "fmt ");
+        fechar_entrada(f, pipe);
+        return 0;
+    }
+
+    // Tamanho 0 ou 0xFFFFFFFF = escrito por quem não sabia o tamanho: lê até EOF
+    uint64_t data_size = chunk_size;
+    if (rf64 && chunk_size == 0xFFFFFFFFu) data_size = ds64_data_size;
+    if (data_size == 0xFFFFFFFFu && !rf64) data_size = 0;
+
+    int is_float = format == WAVE_FORMAT_IEEE_FLOAT;
+    printf("WAV Info: %d Hz, %d canais, %d bits%s%s\n",
+           header->sample_rate, header->channels, header->bits_per_sample,
+           is_float ? " float" : "", rf64 ? " (RF64)" : "");
+    if (data_size == 0)
+        printf("Chunk 'data' found (size unknown, reading to end of stream)\n");
+    else
+        printf("Chunk 'data' found (%llu bytes)\n", (unsigned long long)data_size);
+
+    if (header->channels == 0 || header->channels > MAX_CHANNELS) {
+        fprintf(stderr, "Error: Unsupported channel count (%d)\n", header->channels);
+        fechar_entrada(f, pipe);
+        return 0;
+    }
+    int supported = is_float ? header->bits_per_sample == 32
+                  : format == WAVE_FORMAT_PCM && (header->bits_per_sample == 16 ||
+                                                  header->bits_per_sample == 24 ||
+                                                  header->bits_per_sample == 32);
+    if (!supported) {
+        fprintf(stderr, "Error: Unsupported WAV format (tag 0x%04X, %d-bit). "
+                        "Supported: PCM 16/24/32-bit and float 32-bit.\n",
+                format, header->bits_per_sample);
+        fechar_entrada(f, pipe);
+        return 0;
+    }
+
+    wr->f = f;
+    wr->pipe = pipe;
+    wr->channels = header->channels;
+    wr->bits_per_sample = header->bits_per_sample;
+    wr->is_float = is_float;
+    wr->data_remaining = data_size ? data_size : UINT64_MAX;
+    wr->fator_f = (float)pow(10.0, -DB_REDUCTION / 20.0);
+
+    // Arquivo comum: as amostras são convertidas direto das páginas mapeadas.
+    // O início de 'data' precisa estar alinhado à amostra para as leituras
+    // int16/int32/float (24 bits é lido byte a byte).
+    if (!pipe && map_file(f, &wr->map)) {
+        uint64_t data_start = (uint64_t)ftell(f);
+        unsigned align = header->bits_per_sample == 24 ? 1 : header->bits_per_sample / 8;
+        if (data_start % align == 0 && data_start <= wr->map.size) {
+            if (wr->data_remaining > wr->map.size - data_start)
+                wr->data_remaining = wr->map.size - data_start;
+            wr->map_pos = data_start;
+        } else {
+            unmap_file(&wr->map);
+        }
+    }
+
+    wr->raw = wr->map.data ? NULL : (uint8_t*)malloc(READ_BUFFER_BYTES);
+    // Um pedaço de leitura tem READ_BUFFER_BYTES / frame_bytes quadros inteiros
+    size_t chunk_samples = READ_BUFFER_BYTES / ((size_t)header->channels * (header->bits_per_sample / 8))
+                         * header->channels;
+    wr->converted = (int32_t*)malloc(chunk_samples * sizeof(int32_t));
+    if ((!wr->map.data && !wr->raw) || !wr->converted) {
+        fprintf(stderr, "Error allocating read buffer\n");
+        fechar_entrada(f, pipe);
         return 0;
     }
+    header->total_samples = 0;
     return 1;
 }
 
-int ler_wav_multicanal(const char *arquivo, Channel channels[], TXACHeader *header) {
+int abrir_wav_multicanal(const char *arquivo, WavReader *wr, TXACHeader *header) {
     FILE *f = fopen(arquivo, "rb");
     if (!f) {
         perror("Error opening WAV");
         return 0;
     }
+    return iniciar_leitor_wav(f, 0, wr, header);
+}
+
+// Qualquer outro formato: o FFmpeg decodifica para WAV 32-bit na sua saída
+// padrão e o encoder lê o pipe enquanto ele escreve, sem arquivo temporário.
+// Sem poder voltar no pipe, o chunk 'data' chega com tamanho desconhecido
+// (0xFFFFFFFF) e é lido até o EOF.
+int abrir_wav_ffmpeg(const char *audio_file, WavReader *wr, TXACHeader *header) {
+    const char *ext = strrchr(audio_file, '.');
+    const char *formato = ext ? ext + 1 : "áudio";
 
-    uint8_t hdr[44];
-    if (fread(hdr, 1, 44, f) != 44) {
-        fclose(f);
+    char cmd[2048];
+    snprintf(cmd, sizeof(cmd),
+             "ffmpeg -nostdin -loglevel error -i \"%s\" -f wav -acodec pcm_s32le -rf64 never -",
+             audio_file);
+
+    printf("Converting %s to WAV 32-bit (FFmpeg pipe)...\n", formato);
+    fflush(stdout);
+    FILE *p = popen(cmd, POPEN_READ);
+    if (!p) {
+        perror("Error starting FFmpeg");
         return 0;
     }
+    if (!iniciar_leitor_wav(p, 1, wr, header)) {
+        fprintf(stderr, "Error converting FFmpeg\n");
+        return 0;
+    }
+    return 1;
+}
 
-    memcpy(&header->sample_rate, hdr + 24, 4);
-    memcpy(&header->channels, hdr + 22, 2);
-    memcpy(&header->bits_per_sample, hdr + 34, 2);
-
-    printf("WAV Info: %d Hz, %d canais, %d bits\n", 
-           header->sample_rate, header->channels, header->bits_per_sample);
+// Amostras PCM → int32 na escala do encoder, 8 por vez. Toda entrada passa
+// pela escala de 32 bits (16 bits << 16, 24 bits << 8, float × 2^31) e depois
+// pelas contas da versão escalar (int → float, × fator_f em float,
+// truncamento), então o resultado é o mesmo bit a bit. No modo nativo os
+// inteiros saem como estão.
+static void converter_amostras(const void *raw, unsigned bits, int is_float, int native,
+                               float fator_f, int32_t *dst, size_t n) {
+    const __m256 f = _mm256_set1_ps(fator_f);
+    size_t i = 0;
+    if (is_float) {
+        // 2^31 é potência de 2: v × (2^31·fator_f) arredonda igual a (v·2^31) × fator_f
+        const float escala = 2147483648.0f * fator_f;
+        const __m256 g = _mm256_set1_ps(escala);
+        const float *s = (const float *)raw;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(s + i), g)));
+        for (; i < n; i++) dst[i] = (int32_t)(s[i] * escala);
+    } else if (bits == 16) {
+        const int16_t *s = (const int16_t *)raw;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(s + i)));
+            if (!native)
+                v = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_slli_epi32(v, 16)), f));
+            _mm256_storeu_si256((__m256i *)(dst + i), v);
+        }
+        for (; i < n; i++)
+            dst[i] = native ? s[i] : (int32_t)((((int32_t)s[i]) << 16) * fator_f);
+    } else if (bits == 24) {
+        // 8 amostras = 24 bytes. A permutação leva os bytes 12..27 para a
+        // metade alta e o pshufb põe cada amostra nos 24 bits altos do seu
+        // int32 (= valor << 8). A carga é de 32 bytes, por isso o laço para
+        // 11 amostras antes do fim.
+        const uint8_t *s = (const uint8_t *)raw;
+        const __m256i metades = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+        const __m256i espalha = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                                 -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+        for (; i + 11 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(s + 3 * i));
+            v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, metades), espalha);
+            v = native ? _mm256_srai_epi32(v, 8)
+                       : _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(v), f));
+            _mm256_storeu_si256((__m256i *)(dst + i), v);
+        }
+        for (; i < n; i++) {
+            int32_t v = (int32_t)((uint32_t)s[3 * i] << 8 | (uint32_t)s[3 * i + 1] << 16 |
+                                  (uint32_t)s[3 * i + 2] << 24);
+            dst[i] = native ? v >> 8 : (int32_t)(v * fator_f);
+        }
+    } else {
+        const int32_t *s = (const int32_t *)raw;
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(s + i)));
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvttps_epi32(_mm256_mul_ps(v, f)));
+        }
+        for (; i < n; i++) dst[i] = (int32_t)(s[i] * fator_f);
+    }
+}
 
-    fseek(f, 12, SEEK_SET);
-    uint8_t chunk_id[4];
-    uint32_t chunk_size;
-    int found = 0;
-    
-    while (fread(chunk_id, 1, 4, f) == 4) {
-        fread(&chunk_size, 4, 1, f);
-        
-        if (memcmp(chunk_id, "data", 4) == 0) {
-            printf("Chunk 'data' found (%u bytes)\n", chunk_size);
-            found = 1;
-            break;
+// Quadros intercalados → um vetor por canal. Estéreo e 8 canais saem por
+// permutação/transposição em registrador, 6 canais (5.1) por gather; o resto
+// (e a cauda de menos de 8 quadros) em escalar.
+static void separar_canais(const int32_t *src, size_t frames, int channels, int32_t **dst) {
+    size_t f = 0;
+    switch (channels) {
+    case 1:
+        memcpy(dst[0], src, frames * sizeof(int32_t));
+        return;
+    case 2: {
+        const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        for (; f + 8 <= frames; f += 8) {
+            __m256i a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(src + 2 * f)), idx);
+            __m256i b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(src + 2 * f + 8)), idx);
+            _mm256_storeu_si256((__m256i *)(dst[0] + f), _mm256_permute2x128_si256(a, b, 0x20));
+            _mm256_storeu_si256((__m256i *)(dst[1] + f), _mm256_permute2x128_si256(a, b, 0x31));
         }
-        
-        if (chunk_size > 0 && chunk_size < 0x7FFFFFFF) {
-            fseek(f, chunk_size, SEEK_CUR);
-        } else break;
+        break;
     }
-    
-    if (!found) {
-        fprintf(stderr, "Chunk 'data' not found\n");
-        fclose(f);
-        return 0;
+    case 6: {
+        const __m256i idx = _mm256_setr_epi32(0, 6, 12, 18, 24, 30, 36, 42);
+        for (; f + 8 <= frames; f += 8)
+            for (int c = 0; c < 6; c++)
+                _mm256_storeu_si256((__m256i *)(dst[c] + f),
+                                    _mm256_i32gather_epi32((const int *)(src + 6 * f + c), idx, 4));
+        break;
+    }
+    case 8:
+        for (; f + 8 <= frames; f += 8) {
+            const __m256i *r = (const __m256i *)(src + 8 * f);
+            __m256i r0 = _mm256_loadu_si256(r + 0), r1 = _mm256_loadu_si256(r + 1);
+            __m256i r2 = _mm256_loadu_si256(r + 2), r3 = _mm256_loadu_si256(r + 3);
+            __m256i r4 = _mm256_loadu_si256(r + 4), r5 = _mm256_loadu_si256(r + 5);
+            __m256i r6 = _mm256_loadu_si256(r + 6), r7 = _mm256_loadu_si256(r + 7);
+            __m256i t0 = _mm256_unpacklo_epi32(r0, r1), t1 = _mm256_unpackhi_epi32(r0, r1);
+            __m256i t2 = _mm256_unpacklo_epi32(r2, r3), t3 = _mm256_unpackhi_epi32(r2, r3);
+            __m256i t4 = _mm256_unpacklo_epi32(r4, r5), t5 = _mm256_unpackhi_epi32(r4, r5);
+            __m256i t6 = _mm256_unpacklo_epi32(r6, r7), t7 = _mm256_unpackhi_epi32(r6, r7);
+            __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+            __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+            __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+            __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+            _mm256_storeu_si256((__m256i *)(dst[0] + f), _mm256_permute2x128_si256(u0, u4, 0x20));
+            _mm256_storeu_si256((__m256i *)(dst[1] + f), _mm256_permute2x128_si256(u1, u5, 0x20));
+            _mm256_storeu_si256((__m256i *)(dst[2] + f), _mm256_permute2x128_si256(u2, u6, 0x20));
+            _mm256_storeu_si256((__m256i *)(dst[3] + f), _mm256_permute2x128_si256(u3, u7, 0x20));
+            _mm256_storeu_si256((__m256i *)(dst[4] + f), _mm256_permute2x128_si256(u0, u4, 0x31));
+            _mm256_storeu_si256((__m256i *)(dst[5] + f), _mm256_permute2x128_si256(u1, u5, 0x31));
+            _mm256_storeu_si256((__m256i *)(dst[6] + f), _mm256_permute2x128_si256(u2, u6, 0x31));
+            _mm256_storeu_si256((__m256i *)(dst[7] + f), _mm256_permute2x128_si256(u3, u7, 0x31));
+        }
+        break;
+    default:
+        break;
     }
+    for (; f < frames; f++)
+        for (int c = 0; c < channels; c++) dst[c][f] = src[f * channels + c];
+}
+
+// Lê a próxima janela de até max_frames quadros, separando os canais.
+// Retorna o número de quadros lidos (0 = fim do áudio). O arquivo é lido em
+// pedaços de READ_BUFFER_BYTES, convertido para int32 e só então separado;
+// mapeado, cada pedaço sai direto das páginas do arquivo, sem cópia.
+size_t ler_wav_multicanal(WavReader *wr, Channel channels[], size_t max_frames) {
+    size_t bytes_per_sample = wr->bits_per_sample / 8;
+    size_t frame_bytes = bytes_per_sample * wr->channels;
+    uint64_t remaining_frames = wr->data_remaining / frame_bytes;
+    size_t want = max_frames < remaining_frames ? max_frames : (size_t)remaining_frames;
+    size_t buf_frames = READ_BUFFER_BYTES / frame_bytes;
+    size_t frames = 0;
+
+    int32_t *dst[MAX_CHANNELS];
+    for (int c = 0; c < wr->channels; c++) {
+        channels[c].count = 0;
+        if (want > channels[c].capacity) ensure_channel_capacity(&channels[c], want);
+    }
+
+    while (frames < want) {
+        size_t chunk = want - frames < buf_frames ? want - frames : buf_frames;
+        const uint8_t *src;
+        size_t got;
+        if (wr->map.data) {
+            // data_remaining já foi limitado ao tamanho do arquivo mapeado
+            src = wr->map.data + wr->map_pos;
+            got = chunk;
+        } else {
+            got = fread(wr->raw, frame_bytes, chunk, wr->f);   // só quadros completos
+            src = wr->raw;
+            if (got == 0) break;
+        }
 
-    size_t bytes_per_sample = header->bits_per_sample / 8;
-    size_t samples_per_channel =
-        bytes_per_sample && header->channels
-        ? (size_t)chunk_size / bytes_per_sample / header->channels
-        : 512 * 1024;
-    if (samples_per_channel == 0) samples_per_channel = 1;
+        // 32 bits inteiros no modo nativo já é int32: separa direto do buffer lido
+        const int32_t *inter = (const int32_t *)src;
+        if (!(wr->native && wr->bits_per_sample == 32 && !wr->is_float)) {
+            converter_amostras(src, wr->bits_per_sample, wr->is_float, wr->native, wr->fator_f,
+                               wr->converted, got * wr->channels);
+            inter = wr->converted;
+        }
+        for (int c = 0; c < wr->channels; c++) dst[c] = channels[c].samples + frames;
+        separar_canais(inter, got, wr->channels, dst);
+        frames += got;
 
-    for (int i = 0; i < header->channels; i++) {
-        init_channel(&channels[i], samples_per_channel);
+        if (wr->map.data) {
+            release_mapped(&wr->map, wr->map_pos, wr->map_pos + got * frame_bytes);
+            wr->map_pos += got * frame_bytes;
+        }
+        if (got < chunk) break;
     }
+    for (int c = 0; c < wr->channels; c++) channels[c].count = frames;
+
+    if (wr->data_remaining != UINT64_MAX) wr->data_remaining -= frames * frame_bytes;
+    return frames;
+}
 
-    float fator_f = (float)pow(10.0, -DB_REDUCTION / 20.0);
+// Retorna 0 se o FFmpeg terminou com erro (a saída dele pode estar incompleta)
+int fechar_wav_multicanal(WavReader *wr) {
+    int ok = 1;
+    unmap_file(&wr->map);
+    if (wr->f) ok = fechar_entrada(wr->f, wr->pipe);
+    wr->f = NULL;
+    free(wr->raw);
+    free(wr->converted);
+    wr->raw = NULL;
+    wr->converted = NULL;
+    return ok;
+}
 
-    if (header->bits_per_sample == 32) {
-        int32_t buffer[8 * MAX_CHANNELS];
-        size_t num_read;
-        
-        while ((num_read = fread(buffer, sizeof(int32_t), 8 * header->channels, f)) > 0) {
-            for (size_t i = 0; i < num_read; i++) {
-                int ch = i % header->channels;
-                int32_t s32 = buffer[i];
-                int32_t reduced = (int32_t)(s32 * fator_f);
-                
-                ensure_channel_capacity(&channels[ch], 1);
-                channels[ch].samples[channels[ch].count++] = reduced;
+// Pico de memória residente do processo, em bytes (para --stats)
+static uint64_t peak_rss_bytes(void) {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return (uint64_t)pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+    return (uint64_t)ru.ru_maxrss;          // macOS reporta em bytes
+#else
+    return (uint64_t)ru.ru_maxrss * 1024;   // Linux reporta em KB
+#endif
+#endif
+}
+
+// ============================================================================
+// POOL DE THREADS COM ROUBO DE TAREFAS
+// Cada worker tem a própria fila: o dono tira do fim (LIFO, cache quente) e
+// quem fica sem trabalho rouba do início da fila dos outros (FIFO).
+// ============================================================================
+
+typedef void (*TaskFunc)(void *arg);
+
+typedef struct {
+    TaskFunc fn;
+    void *arg;
+} PoolTask;
+
+typedef struct {
+    pthread_mutex_t lock;
+    PoolTask *items;
+    size_t head;       // próximo a ser roubado
+    size_t tail;       // próximo slot livre (o dono tira de tail - 1)
+    size_t capacity;
+} WorkDeque;
+
+typedef struct WorkerArg WorkerArg;
+
+typedef struct {
+    int num_workers;
+    pthread_t *threads;
+    WorkDeque *deques;
+    WorkerArg *args;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    size_t queued;     // tarefas nas filas (lido sem lock pelos workers)
+    size_t pending;    // tarefas ainda não concluídas
+    size_t next_deque; // distribuição round-robin no submit
+    int shutdown;
+} ThreadPool;
+
+struct WorkerArg {
+    ThreadPool *pool;
+    int id;
+};
+
+static int deque_pop(WorkDeque *d, PoolTask *out) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) {
+        *out = d->items[--d->tail];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static int deque_steal(WorkDeque *d, PoolTask *out) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) {
+        *out = d->items[d->head++];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static void deque_push(WorkDeque *d, PoolTask task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->head == d->tail) d->head = d->tail = 0;
+    if (d->tail == d->capacity) {
+        // Compacta antes de crescer: o início pode ter sido roubado
+        size_t live = d->tail - d->head;
+        memmove(d->items, d->items + d->head, live * sizeof(PoolTask));
+        d->head = 0;
+        d->tail = live;
+        if (d->tail == d->capacity) {
+            size_t new_cap = d->capacity * GROWTH_FACTOR;
+            PoolTask *grown = (PoolTask*)realloc(d->items, new_cap * sizeof(PoolTask));
+            if (!grown) {
+                fprintf(stderr, "Error reallocating task queue\n");
+                exit(1);
             }
+            d->items = grown;
+            d->capacity = new_cap;
         }
     }
-    else if (header->bits_per_sample == 16) {
-        int16_t buffer[8 * MAX_CHANNELS];
-        size_t num_read;
-        
-        while ((num_read = fread(buffer, sizeof(int16_t), 8 * header->channels, f)) > 0) {
-            for (size_t i = 0; i < num_read; i++) {
-                int ch = i % header->channels;
-                int16_t s16 = buffer[i];
-                int32_t s32 = ((int32_t)s16) << 16;
-                int32_t reduced = (int32_t)(s32 * fator_f);
-                
-                ensure_channel_capacity(&channels[ch], 1);
-                channels[ch].samples[channels[ch].count++] = reduced;
-            }
+    d->items[d->tail++] = task;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static int pool_take(ThreadPool *pool, int id, PoolTask *task) {
+    if (deque_pop(&pool->deques[id], task)) return 1;
+    for (int k = 1; k < pool->num_workers; k++) {
+        if (deque_steal(&pool->deques[(id + k) % pool->num_workers], task)) return 1;
+    }
+    return 0;
+}
+
+static void *pool_worker(void *arg) {
+    WorkerArg *wa = (WorkerArg*)arg;
+    ThreadPool *pool = wa->pool;
+    PoolTask task;
+
+    for (;;) {
+        if (pool_take(pool, wa->id, &task)) {
+            __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_ACQ_REL);
+            task.fn(task.arg);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0) pthread_cond_broadcast(&pool->done_cv);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
         }
-    } else {
-        fprintf(stderr, "Error: Only 16-bit and 32-bit supported. File is %d-bit.\n", header->bits_per_sample);
-        fclose(f);
-        return 0;
+
+        // Nada para fazer nem para roubar: dorme até o próximo submit
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutdown && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0) {
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+        }
+        int stop = pool->shutdown && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) break;
     }
+    return NULL;
+}
 
-    fclose(f);
-    header->total_samples = channels[0].count;
-    printf("Done reading: %zu samples per channel\n", channels[0].count);
-    return 1;
+static int detect_cpu_count(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+static void pool_init(ThreadPool *pool, int num_workers) {
+    memset(pool, 0, sizeof(*pool));
+    pool->num_workers = num_workers;
+    pool->threads = (pthread_t*)malloc(num_workers * sizeof(pthread_t));
+    pool->deques = (WorkDeque*)calloc(num_workers, sizeof(WorkDeque));
+    pool->args = (WorkerArg*)malloc(num_workers * sizeof(WorkerArg));
+    if (!pool->threads || !pool->deques || !pool->args) {
+        fprintf(stderr, "Error allocating thread pool\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+
+    for (int i = 0; i < num_workers; i++) {
+        WorkDeque *d = &pool->deques[i];
+        pthread_mutex_init(&d->lock, NULL);
+        d->capacity = 64;
+        d->items = (PoolTask*)malloc(d->capacity * sizeof(PoolTask));
+        if (!d->items) {
+            fprintf(stderr, "Error allocating task queue\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pool->args[i].pool = pool;
+        pool->args[i].id = i;
+        pthread_create(&pool->threads[i], NULL, pool_worker, &pool->args[i]);
+    }
+}
+
+static void pool_submit(ThreadPool *pool, TaskFunc fn, void *arg) {
+    PoolTask task = { fn, arg };
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    // Conta antes de publicar: um worker pode pegar a tarefa logo após o push
+    __atomic_fetch_add(&pool->queued, 1, __ATOMIC_ACQ_REL);
+    deque_push(&pool->deques[pool->next_deque], task);
+    pool->next_deque = (pool->next_deque + 1) % pool->num_workers;
+    pthread_cond_signal(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Espera todas as tarefas enviadas até aqui terminarem
+static void pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) pthread_cond_wait(&pool->done_cv, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_destroy(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->threads[i], NULL);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].items);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_cond_destroy(&pool->done_cv);
+    free(pool->threads);
+    free(pool->deques);
+    free(pool->args);
 }
 
 // ============================================================================
-// COMPRESSÃO COM DELTA
+// PREDIÇÃO POR BLOCO
+// O encoder escolhe, para cada bloco, o preditor que deixa os menores resíduos:
+//   - polinômio fixo de ordem 0..4 (ordem 1 = o delta clássico)
+//   - LPC quantizado de ordem até LPC_MAX_ORDER (Levinson-Durbin)
+// resíduo[i] = amostra[i] - (Σ coef[j] * amostra[i-1-j]) >> shift
+// Amostras antes do início do bloco valem 0, então o bloco continua
+// decodificável sozinho. A soma é feita em int32 com wrap-around dos dois
+// lados: exato para os fixos (shift 0) e, no LPC, a precisão dos
+// coeficientes é limitada para que a soma verdadeira caiba em 32 bits.
+// Se todas as amostras do bloco terminam em 'wasted' bits zero (áudio de
+// 16 bits em 32, ganho em potência de 2), o bloco é predito já deslocado.
 // ============================================================================
 
-void *compactar_canal_4bit_thread(void *arg) {
-    ThreadData *td = (ThreadData*)arg;
-    Channel *ch = td->channel;
-    Binary4BitBuffer *out = td->output;
-    
-    init_4bit_buffer(out);
-    RiceBuffer rice_out;
-    rice_writer_init(&rice_out, out);
-    
-    printf("  [Channel %d] Applying delta encoding...\n", td->channel_id);
-    
-    int32_t *deltas = NULL;
-    size_t delta_count = 0;
-    apply_delta_encoding(ch, &deltas, &delta_count);
-    
-    if (!deltas || delta_count == 0) {
-        printf("  [Channel %d] Error: no deltas generated\n", td->channel_id);
-        return NULL;
+typedef struct {
+    uint8_t order;          // 0..LPC_MAX_ORDER
+    uint8_t lpc;            // 0 = polinômio fixo, 1 = LPC quantizado
+    uint8_t shift;          // LPC: deslocamento aplicado à soma
+    uint8_t wasted;         // bits zero no fim de todas as amostras (0 = nenhum)
+    int32_t coef[LPC_MAX_ORDER];
+} Predictor;
+
+static const int32_t fixed_coefs[FIXED_MAX_ORDER + 1][FIXED_MAX_ORDER] = {
+    { 0 },
+    { 1 },
+    { 2, -1 },
+    { 3, -3, 1 },
+    { 4, -6, 4, -1 }
+};
+
+static void predictor_fixed(Predictor *p, unsigned order) {
+    memset(p, 0, sizeof(*p));
+    p->order = (uint8_t)order;
+    for (unsigned j = 0; j < order; j++) p->coef[j] = fixed_coefs[order][j];
+}
+
+// Bytes do preditor no header do bloco
+static size_t predictor_header_size(const Predictor *p) {
+    return (p->lpc ? 2 + 2 * (size_t)p->order : 1) + (p->wasted ? 1 : 0);
+}
+
+// Byte 0: ordem (bits 0-5), bit 6 = byte de bits desperdiçados no fim, bit 7 = LPC
+static void predictor_write_header(const Predictor *p, uint8_t *dst) {
+    dst[0] = (uint8_t)(p->order | (p->wasted ? 0x40 : 0) | (p->lpc ? 0x80 : 0));
+    size_t at = 1;
+    if (p->lpc) {
+        dst[at++] = p->shift;
+        for (unsigned j = 0; j < p->order; j++) {
+            uint16_t c = (uint16_t)(int16_t)p->coef[j];
+            dst[at++] = (uint8_t)(c & 0xFF);
+            dst[at++] = (uint8_t)(c >> 8);
+        }
     }
-    
-    printf("  [Channel %d] Compressing %zu deltas to 4-bit...\n", td->channel_id, delta_count);
-    
+    if (p->wasted) dst[at] = p->wasted;
+}
+
+// Zeros comuns no fim de todas as amostras: OR do bloco em AVX2 e ctz.
+// Bloco todo zero é constante e nem chega aqui.
+static unsigned wasted_bits(const int32_t *s, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
     size_t i = 0;
-    
-while (i < delta_count) {
+    for (; i + 8 <= n; i += 8)
+        acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i *)(s + i)));
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    uint32_t bits = lanes[0] | lanes[1] | lanes[2] | lanes[3] |
+                    lanes[4] | lanes[5] | lanes[6] | lanes[7];
+    for (; i < n; i++) bits |= (uint32_t)s[i];
+    return bits ? (unsigned)__builtin_ctz(bits) : 0;
+}
+
+// dst[i] = s[i] >> shift (exato: os bits que saem são zero)
+static void shift_samples(const int32_t *s, size_t n, unsigned shift, int32_t *dst) {
+    __m128i count = _mm_cvtsi32_si128((int)shift);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_sra_epi32(_mm256_loadu_si256((const __m256i *)(s + i)), count));
+    for (; i < n; i++) dst[i] = s[i] >> shift;
+}
+
+static void residuals_scalar(const int32_t *s, size_t from, size_t n,
+                             const Predictor *p, int32_t *res) {
+    for (size_t i = from; i < n; i++) {
+        uint32_t sum = 0;
+        unsigned order = p->order < i ? p->order : (unsigned)i;
+        for (unsigned j = 0; j < order; j++)
+            sum += (uint32_t)p->coef[j] * (uint32_t)s[i - 1 - j];
+        res[i] = (int32_t)((uint32_t)s[i] - (uint32_t)((int32_t)sum >> p->shift));
+    }
+}
+
+// Resíduos com AVX2, 8 amostras por vez (o aquecimento e a cauda em escalar)
+static void compute_residuals(const int32_t *s, size_t n, const Predictor *p,
+                              int32_t *res) {
+    size_t warm = p->order < n ? p->order : n;
+    residuals_scalar(s, 0, warm, p, res);
+
+    size_t i = warm;
+    __m128i shift = _mm_cvtsi32_si128(p->shift);
+    for (; i + 8 <= n; i += 8) {
+        __m256i sum = _mm256_setzero_si256();
+        for (unsigned j = 0; j < p->order; j++) {
+            __m256i c = _mm256_set1_epi32(p->coef[j]);
+            __m256i h = _mm256_loadu_si256((const __m256i *)(s + i - 1 - j));
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(c, h));
+        }
+        __m256i cur = _mm256_loadu_si256((const __m256i *)(s + i));
+        _mm256_storeu_si256((__m256i *)(res + i),
+                            _mm256_sub_epi32(cur, _mm256_sra_epi32(sum, shift)));
+    }
+    residuals_scalar(s, i, n, p, res);
+}
+
+// Custo aproximado em bits de um bloco de resíduos num código Rice ideal
+static uint64_t residual_cost(const int32_t *res, size_t n) {
+    if (n == 0) return 0;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += zigzag32(res[i]);
+    unsigned k = residual_k(sum * 16 / n);
+    return (uint64_t)n * (k + 1) + (sum >> k);
+}
+
+// Coeficientes LPC de todas as ordens até max_order (Levinson-Durbin sobre a
+// autocorrelação com janela de Welch). lpc[o-1][*] = coeficientes da ordem o.
+static int compute_lpc(const int32_t *s, size_t n, unsigned max_order,
+                       double lpc[LPC_MAX_ORDER][LPC_MAX_ORDER],
+                       double err[LPC_MAX_ORDER + 1]) {
+    double autoc[LPC_MAX_ORDER + 1];
+    double *w = (double *)malloc(n * sizeof(double));
+    if (!w) return -1;
+    double half = (double)(n - 1) / 2.0, den = (double)(n + 1) / 2.0;
+    for (size_t i = 0; i < n; i++) {
+        double x = ((double)i - half) / den;
+        w[i] = (double)s[i] * (1.0 - x * x);
+    }
+    // Autocorrelação com 4 somas parciais em AVX2 (só a estimativa depende dela)
+    for (unsigned lag = 0; lag <= max_order; lag++) {
+        __m256d acc4 = _mm256_setzero_pd();
+        size_t i = lag;
+        for (; i + 4 <= n; i += 4)
+            acc4 = _mm256_add_pd(acc4, _mm256_mul_pd(_mm256_loadu_pd(w + i),
+                                                     _mm256_loadu_pd(w + i - lag)));
+        double part[4];
+        _mm256_storeu_pd(part, acc4);
+        double acc = (part[0] + part[1]) + (part[2] + part[3]);
+        for (; i < n; i++) acc += w[i] * w[i - lag];
+        autoc[lag] = acc;
+    }
+    free(w);
+    if (autoc[0] <= 0.0) return -1;
+
+    double a[LPC_MAX_ORDER] = { 0 };
+    double e = autoc[0] * (1.0 + 1e-9);
+    err[0] = e;
+    for (unsigned o = 0; o < max_order; o++) {
+        double r = -autoc[o + 1];
+        for (unsigned j = 0; j < o; j++) r -= a[j] * autoc[o - j];
+        r /= e;
+        a[o] = r;
+        for (unsigned j = 0; j < o / 2; j++) {
+            double t = a[j];
+            a[j]         += r * a[o - 1 - j];
+            a[o - 1 - j] += r * t;
+        }
+        if (o & 1) a[o / 2] += a[o / 2] * r;
+        e *= 1.0 - r * r;
+        if (e <= 0.0) e = 1e-12;
+        err[o + 1] = e;
+        for (unsigned j = 0; j <= o; j++) lpc[o][j] = -a[j];
+    }
+    return 0;
+}
+
+// Quantiza com 'precision' bits (com sinal, no máximo QLP_PRECISION para caber
+// em int16), propagando o erro de arredondamento
+static int quantize_lpc(const double *c, unsigned order, int precision, Predictor *p) {
+    double cmax = 0.0;
+    for (unsigned j = 0; j < order; j++)
+        if (fabs(c[j]) > cmax) cmax = fabs(c[j]);
+    if (cmax <= 0.0) return -1;
+
+    int log2cmax;
+    frexp(cmax, &log2cmax);
+    int shift = precision - 1 - log2cmax;
+    if (shift > 15) shift = 15;
+    if (shift < 0) return -1;
+
+    const int32_t qmax = (1 << (precision - 1)) - 1;
+    double error = 0.0;
+    memset(p, 0, sizeof(*p));
+    p->order = (uint8_t)order;
+    p->lpc   = 1;
+    p->shift = (uint8_t)shift;
+    for (unsigned j = 0; j < order; j++) {
+        error += c[j] * (double)(1 << shift);
+        int32_t q = (int32_t)lround(error);
+        if (q >  qmax) q =  qmax;
+        if (q < -qmax) q = -qmax;
+        error -= q;
+        p->coef[j] = q;
+    }
+    return 0;
+}
+
+// Escolhe o preditor do bloco e deixa os resíduos dele em 'res'.
+// 'scratch' precisa de espaço para n valores.
+static void choose_predictor(const int32_t *s, size_t n, Predictor *best,
+                             int32_t *res, int32_t *scratch) {
+    int32_t peak = 0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t m = s[i] < 0 ? -(s[i] + 1) : s[i];
+        if (m > peak) peak = m;
+    }
+    int sample_bits = (peak ? 33 - __builtin_clz((uint32_t)peak) : 1);
+
+    predictor_fixed(best, 1);
+    compute_residuals(s, n, best, res);
+    uint64_t best_cost = residual_cost(res, n) + 8 * predictor_header_size(best);
+
+    Predictor cand;
+    for (unsigned order = 0; order <= FIXED_MAX_ORDER; order++) {
+        if (order == 1 || order >= n) continue;
+        predictor_fixed(&cand, order);
+        compute_residuals(s, n, &cand, scratch);
+        uint64_t cost = residual_cost(scratch, n) + 8 * predictor_header_size(&cand);
+        if (cost < best_cost) {
+            best_cost = cost;
+            *best = cand;
+            memcpy(res, scratch, n * sizeof(int32_t));
+        }
+    }
+
+    if (n <= 4 * LPC_MAX_ORDER) return;
+
+    // Ordem do LPC pela estimativa de bits do erro de predição de cada ordem
+    double lpc[LPC_MAX_ORDER][LPC_MAX_ORDER], err[LPC_MAX_ORDER + 1];
+    if (compute_lpc(s, n, LPC_MAX_ORDER, lpc, err) < 0) return;
+    unsigned lpc_order = 0;
+    double lpc_bits = 0.0;
+    for (unsigned o = 1; o <= LPC_MAX_ORDER; o++) {
+        double per_sample = err[o] > 0.0 ? 0.5 * log2(err[o] / (double)n) : 0.0;
+        double bits = (double)n * (per_sample > 0.0 ? per_sample : 0.0) + 16.0 * o;
+        if (lpc_order == 0 || bits < lpc_bits) { lpc_order = o; lpc_bits = bits; }
+    }
+    // |soma| < ordem * 2^(precisão-1) * 2^(sample_bits-1) tem que caber em int32
+    int order_bits = 32 - __builtin_clz(lpc_order);
+    int precision = 32 - sample_bits - order_bits;
+    if (precision > QLP_PRECISION) precision = QLP_PRECISION;
+    if (precision < 5 || quantize_lpc(lpc[lpc_order - 1], lpc_order, precision, &cand) < 0)
+        return;
+
+    compute_residuals(s, n, &cand, scratch);
+    uint64_t cost = residual_cost(scratch, n) + 8 * predictor_header_size(&cand);
+    if (cost < best_cost) {
+        *best = cand;
+        memcpy(res, scratch, n * sizeof(int32_t));
+    }
+}
+
+// ============================================================================
+// CASCATA SIGN-SIGN LMS (--best, TXAC_FLAG_LMS)
+// Depois do preditor do bloco, os resíduos passam por filtros adaptativos em
+// série. Cada estágio prevê a sua entrada a partir das últimas 'order'
+// entradas (saturadas em int16) e ajusta os pesos int16 só pelos sinais:
+//   w[j] += sign(erro) * sign(entrada[i-1-j]) * LMS_STEP
+// O produto escalar usa pmaddwd (16 × 16 → 32 bits) e o ajuste, soma de int16,
+// 16 pesos por registrador. O estado zera em cada bloco; o decoder refaz as
+// mesmas contas na ordem inversa dos estágios, bit a bit.
+// ============================================================================
+#define LMS_STAGES    2
+#define LMS_MAX_ORDER 64
+#define LMS_STEP      2
+
+static const struct { unsigned order, shift; } lms_cascade[LMS_STAGES] = {
+    { 64, 11 },
+    { 16, 10 }
+};
+
+static inline int16_t lms_sat16(int32_t v) {
+    return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+static inline int32_t lms_dot(const int16_t *w, const int16_t *h, unsigned order) {
+    __m256i acc = _mm256_setzero_si256();
+    for (unsigned j = 0; j < order; j += 16)
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+                  _mm256_load_si256((const __m256i *)(w + j)),
+                  _mm256_loadu_si256((const __m256i *)(h + j))));
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+
+static inline void lms_adapt(int16_t *w, const int16_t *sgn, unsigned order, int32_t err) {
+    for (unsigned j = 0; j < order; j += 16) {
+        __m256i wv = _mm256_load_si256((const __m256i *)(w + j));
+        __m256i sv = _mm256_loadu_si256((const __m256i *)(sgn + j));
+        wv = err > 0 ? _mm256_add_epi16(wv, sv) : _mm256_sub_epi16(wv, sv);
+        _mm256_store_si256((__m256i *)(w + j), wv);
+    }
+}
+
+// Um estágio sobre o bloco inteiro, no lugar. decode = 0: x vira o erro de
+// predição; decode = 1: x (erro) volta a ser a entrada do estágio.
+// hist/sgn precisam de n + order posições.
+static void lms_stage(int32_t *x, size_t n, unsigned order, unsigned shift,
+                      int decode, int16_t *hist, int16_t *sgn) {
+    int16_t w[LMS_MAX_ORDER] __attribute__((aligned(32)));
+    memset(w, 0, sizeof(w));
+    memset(hist, 0, order * sizeof(int16_t));
+    memset(sgn, 0, order * sizeof(int16_t));
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t pred = (uint32_t)(lms_dot(w, hist + i, order) >> shift);
+        int32_t in, err;
+        if (decode) {
+            err = x[i];
+            in  = (int32_t)((uint32_t)err + pred);
+            x[i] = in;
+        } else {
+            in  = x[i];
+            err = (int32_t)((uint32_t)in - pred);
+            x[i] = err;
+        }
+        if (err != 0) lms_adapt(w, sgn + i, order, err);
+        hist[i + order] = lms_sat16(in);
+        sgn[i + order]  = (int16_t)(in > 0 ? LMS_STEP : in < 0 ? -LMS_STEP : 0);
+    }
+}
+
+// --best: passa os resíduos do bloco pela cascata e fica com ela só se o custo
+// estimado cair. Devolve quantos estágios foram aplicados (vai no header).
+static unsigned lms_try_block(int32_t *res, size_t n, int32_t *scratch,
+                              int16_t *hist, int16_t *sgn) {
+    memcpy(scratch, res, n * sizeof(int32_t));
+    for (unsigned st = 0; st < LMS_STAGES; st++)
+        lms_stage(scratch, n, lms_cascade[st].order, lms_cascade[st].shift, 0, hist, sgn);
+    if (residual_cost(scratch, n) >= residual_cost(res, n)) return 0;
+    memcpy(res, scratch, n * sizeof(int32_t));
+    return LMS_STAGES;
+}
+
+// ============================================================================
+// ACOPLAMENTO ESTÉREO POR BLOCO (TXAC_FLAG_STEREO)
+// Pares de canais vizinhos (máscara no header, bit i = canais i e i+1) são
+// trocados por combinações menos correlacionadas antes da predição. O modo é
+// escolhido bloco a bloco e vai no header do bloco do canal da esquerda:
+//   0 = L/R (independentes)   1 = L/S   2 = S/R   3 = M/S
+// com S = L - R e M = (L + R) >> 1. O decoder desfaz antes do ganho.
+// ============================================================================
+#define STEREO_INDEPENDENT 0
+#define STEREO_LEFT_SIDE   1
+#define STEREO_SIDE_RIGHT  2
+#define STEREO_MID_SIDE    3
+
+// Tarefa do pool: escolhe e aplica o modo dos blocos de um par num segmento
+typedef struct {
+    Channel *left, *right;
+    uint8_t *modes;          // modo por bloco da janela (canal da esquerda)
+    uint32_t first_block;
+    uint32_t block_count;
+    uint32_t block_size;
+} CouplingTask;
+
+static inline uint64_t abs64(int64_t v) { return (uint64_t)(v < 0 ? -v : v); }
+
+// Escolhe o modo pelo custo de um preditor fixo de ordem 2 em cada um dos
+// quatro sinais (L, R, M, S) e já troca as amostras no lugar. Se algum S não
+// couber em int32 o par fica independente.
+static uint8_t stereo_choose(int32_t *l, int32_t *r, size_t n) {
+    uint64_t cl = 0, cr = 0, cm = 0, cs = 0;
+    int64_t pl1 = 0, pl2 = 0, pr1 = 0, pr2 = 0, pm1 = 0, pm2 = 0, ps1 = 0, ps2 = 0;
+    for (size_t i = 0; i < n; i++) {
+        int64_t L = l[i], R = r[i], S = L - R, M = (L + R) >> 1;
+        if (S != (int32_t)S) return STEREO_INDEPENDENT;
+        cl += abs64(L - 2 * pl1 + pl2); pl2 = pl1; pl1 = L;
+        cr += abs64(R - 2 * pr1 + pr2); pr2 = pr1; pr1 = R;
+        cm += abs64(M - 2 * pm1 + pm2); pm2 = pm1; pm1 = M;
+        cs += abs64(S - 2 * ps1 + ps2); ps2 = ps1; ps1 = S;
+    }
+
+    uint8_t mode = STEREO_INDEPENDENT;
+    uint64_t best = cl + cr;
+    if (cl + cs < best) { best = cl + cs; mode = STEREO_LEFT_SIDE; }
+    if (cs + cr < best) { best = cs + cr; mode = STEREO_SIDE_RIGHT; }
+    if (cm + cs < best) { best = cm + cs; mode = STEREO_MID_SIDE; }
+
+    for (size_t i = 0; i < n; i++) {
+        int32_t L = l[i], R = r[i], S = L - R;
+        switch (mode) {
+        case STEREO_LEFT_SIDE:  r[i] = S; break;
+        case STEREO_SIDE_RIGHT: l[i] = S; break;
+        case STEREO_MID_SIDE:   l[i] = (int32_t)(((int64_t)L + R) >> 1); r[i] = S; break;
+        default: break;
+        }
+    }
+    return mode;
+}
+
+void acoplar_segmento_task(void *arg) {
+    CouplingTask *ct = (CouplingTask*)arg;
+    for (uint32_t b = 0; b < ct->block_count; b++) {
+        uint32_t blk = ct->first_block + b;
+        uint64_t first = (uint64_t)blk * ct->block_size;
+        size_t n = 0;
+        if (first < ct->left->count) {
+            n = ct->left->count - first < ct->block_size ? ct->left->count - first : ct->block_size;
+        }
+        ct->modes[blk] = stereo_choose(ct->left->samples + first, ct->right->samples + first, n);
+    }
+}
+
+// ============================================================================
+// CUSTO DOS TOKENS
+// Tamanho exato, em bits, do que rice_write_token escreveria: usado pelo
+// parse ótimo e para decidir se um grupo '(' compensa no parse guloso.
+// ============================================================================
+typedef struct {
+    int binary;
+    int groups;           // RiceBuffer.groups: a run paga o bit de seleção
+    const uint8_t *k;     // k por posição (modo binário), ou NULL = k_fixed
+    unsigned k_fixed;
+} TokenCost;
+
+static inline unsigned cost_rice(uint64_t s, unsigned k) {
+    uint64_t q = s >> k;
+    if (q < RICE_ESCAPE_Q) return (unsigned)q + 1 + k;
+    return RICE_ESCAPE_Q + 6 + (64 - (unsigned)__builtin_clzll(s));
+}
+
+static inline unsigned cost_expgolomb(uint64_t n) {
+    return 2 * (64 - (unsigned)__builtin_clzll(n + 1)) - 1;
+}
+
+static inline unsigned cost_text_char(char c) {
+    return rice_code_len[1][char_to_symbol[(uint8_t)c] - 1];
+}
+
+static unsigned cost_text_u64(uint64_t value) {
+    unsigned bits = 0;
+    do {
+        bits += cost_text_char((char)('0' + value % 10));
+        value /= 10;
+    } while (value != 0);
+    return bits;
+}
+
+// Bits do token que começa na posição pos, como rice_write_token o escreveria
+static unsigned token_cost(const TokenCost *tc, uint32_t pos, int32_t value,
+                           char operation, uint64_t argument) {
+    if (tc->binary) {
+        uint64_t z = zigzag32(value);
+        unsigned k = tc->k ? tc->k[pos] : tc->k_fixed;
+        if (operation == '(')
+            return cost_rice(0, k) + 1 + cost_expgolomb((uint32_t)value - 1) +
+                   cost_expgolomb(argument - GROUP_MIN_LEN);
+        if (operation == '\0') return cost_rice(z + 2, k);
+        return cost_rice(operation == '^' ? 0 : 1, k) + (operation == '^' && tc->groups) + cost_rice(z, k) +
+               cost_expgolomb(operation == '^' ? argument - 2 : argument);
+    }
+    unsigned bits = cost_text_char(',');
+    if (operation == '(')
+        return bits + cost_text_char('(') + cost_text_u64((uint32_t)value) +
+               cost_text_char(')') + cost_text_u64(argument);
+    if (value < 0) bits += cost_text_char('-');
+    bits += cost_text_u64(value < 0 ? (uint64_t)(-(int64_t)value) : (uint32_t)value);
+    if (operation != '\0') bits += cost_text_char(operation) + cost_text_u64(argument);
+    return bits;
+}
+
+// ============================================================================
+// LOCALIZADOR DE MATCHES DO SNIPER (--window)
+// Para cada posição do bloco, a próxima reaparição do mesmo valor a até
+// `window` amostras. Janelas pequenas do parse guloso usam a varredura SIMD;
+// acima de MATCH_SCAN_LIMIT, ou no parse ótimo (que percorre todas as
+// reaparições), o bloco é indexado uma vez, de trás para frente, por uma
+// tabela hash valor → última posição vista, o que dá a cadeia next[] e cada
+// busca vira O(1). rep_after[] responde em O(1) se há repetição dentro de
+// um buraco, sem revarrer o trecho.
+// ============================================================================
+#define SNIPER_WINDOW_DEFAULT 100
+#define SNIPER_WINDOW_MAX     65536
+#define MATCH_SCAN_LIMIT      64   // até aqui a varredura ganha da indexação
+#define MATCH_MAX_CHAIN       64   // candidatos por posição no parse ótimo
+#define MATCH_NONE            UINT32_MAX
+
+typedef struct {
+    int window;
+    int indexed;          // usa next[] em vez da varredura
+    uint32_t *next;       // próxima posição com o mesmo valor (MATCH_NONE = nenhuma)
+    uint32_t *rep_after;  // primeira posição j >= i com deltas[j] == deltas[j + 1]
+    int32_t  *keys;       // tabela hash aberta (potência de 2, carga <= 1/2)
+    uint32_t *slots;      // última posição vista de cada chave
+    uint32_t *stamps;     // bloco em que o slot foi escrito: a tabela não é limpa
+    uint32_t  mask;
+    int       shift;      // hash multiplicativo: bits altos
+    uint32_t  stamp;
+} MatchFinder;
+
+// Contadores de uma passada do parse (--stats)
+typedef struct {
+    uint64_t sniper_lookups;  // posições em que um sniper foi procurado
+    uint64_t sniper_found;    // ... com reaparição dentro da janela
+    uint64_t sniper_used;     // snipers emitidos
+    uint64_t group_tokens;    // grupos emitidos
+    uint64_t group_samples;   // resíduos cobertos por eles
+} ParseStats;
+
+static void match_finder_init(MatchFinder *mf, int window, int indexed, uint32_t block_size) {
+    memset(mf, 0, sizeof(*mf));
+    mf->window = window;
+    mf->indexed = indexed;
+    mf->rep_after = (uint32_t*)malloc(((size_t)block_size + 1) * sizeof(uint32_t));
+    if (!mf->rep_after) {
+        fprintf(stderr, "Error allocating match finder\n");
+        exit(1);
+    }
+    if (!mf->indexed) return;
+
+    uint32_t size = 16;
+    mf->shift = 28;
+    while (size < 2 * block_size) { size <<= 1; mf->shift--; }
+    mf->mask   = size - 1;
+    mf->next   = (uint32_t*)malloc((size_t)block_size * sizeof(uint32_t));
+    mf->keys   = (int32_t*)malloc((size_t)size * sizeof(int32_t));
+    mf->slots  = (uint32_t*)malloc((size_t)size * sizeof(uint32_t));
+    mf->stamps = (uint32_t*)calloc(size, sizeof(uint32_t));
+    if (!mf->next || !mf->keys || !mf->slots || !mf->stamps) {
+        fprintf(stderr, "Error allocating match finder\n");
+        exit(1);
+    }
+}
+
+static void match_finder_free(MatchFinder *mf) {
+    free(mf->next);
+    free(mf->rep_after);
+    free(mf->keys);
+    free(mf->slots);
+    free(mf->stamps);
+}
+
+// Indexa um bloco: rep_after[] sempre, next[] só no modo indexado
+static void match_finder_prepare(MatchFinder *mf, const int32_t *deltas, size_t n) {
+    mf->rep_after[n] = (uint32_t)n;
+    if (n > 0) mf->rep_after[n - 1] = (uint32_t)n;
+    for (size_t i = n > 1 ? n - 1 : 0; i-- > 0;)
+        mf->rep_after[i] = deltas[i] == deltas[i + 1] ? (uint32_t)i : mf->rep_after[i + 1];
+
+    if (!mf->indexed) return;
+    if (++mf->stamp == 0) {
+        memset(mf->stamps, 0, ((size_t)mf->mask + 1) * sizeof(uint32_t));
+        mf->stamp = 1;
+    }
+    for (size_t i = n; i-- > 0;) {
+        int32_t v = deltas[i];
+        uint32_t h = ((uint32_t)v * 0x9E3779B1u) >> mf->shift;
+        while (mf->stamps[h] == mf->stamp && mf->keys[h] != v) h = (h + 1) & mf->mask;
+        if (mf->stamps[h] == mf->stamp) {
+            mf->next[i] = mf->slots[h];
+        } else {
+            mf->next[i] = MATCH_NONE;
+            mf->stamps[h] = mf->stamp;
+            mf->keys[h] = v;
+        }
+        mf->slots[h] = (uint32_t)i;
+    }
+}
+
+// Primeira reaparição de deltas[i] em [i + 2, limit], ou -1
+static inline int match_first(const MatchFinder *mf, const int32_t *deltas, int i, int limit) {
+    if (!mf->indexed) return find_next_match(deltas, i + 2, limit, deltas[i]);
+    uint32_t j = mf->next[i];
+    if (j == (uint32_t)i + 1) j = mf->next[j];
+    return j != MATCH_NONE && j <= (uint32_t)limit ? (int)j : -1;
+}
+
+// Reaparição seguinte a j (que tem o mesmo valor) até limit, ou -1
+static inline int match_following(const MatchFinder *mf, const int32_t *deltas, int j, int limit) {
+    if (!mf->indexed) return j < limit ? find_next_match(deltas, j + 1, limit, deltas[j]) : -1;
+    uint32_t k = mf->next[j];
+    return k != MATCH_NONE && k <= (uint32_t)limit ? (int)k : -1;
+}
+
+// ============================================================================
+// GRUPOS '(' (TXAC_FLAG_GROUPS, --groups)
+// Back-reference estilo LZ77 sobre os resíduos do bloco: "(D)N" copia os N
+// resíduos que estavam D posições atrás. Fica dentro do bloco, que continua
+// decodificável sozinho. As posições são encadeadas por um hash dos
+// GROUP_MIN_LEN resíduos que começam nelas (prev[] aponta para a anterior com
+// o mesmo hash); a busca percorre até GROUP_MAX_CHAIN candidatas e mede cada
+// match com AVX2.
+// ============================================================================
+#define GROUP_MAX_CHAIN 16
+
+typedef struct {
+    uint32_t *prev;       // posição anterior com o mesmo hash (MATCH_NONE = nenhuma)
+    uint32_t *head;       // tabela: hash → última posição indexada
+    uint32_t *stamps;     // bloco em que a entrada foi escrita
+    uint32_t  mask;
+    int       shift;
+    uint32_t  stamp;
+} GroupFinder;
+
+static void group_finder_init(GroupFinder *gf, uint32_t block_size) {
+    memset(gf, 0, sizeof(*gf));
+    uint32_t size = 16;
+    gf->shift = 28;
+    while (size < 2 * block_size) { size <<= 1; gf->shift--; }
+    gf->mask   = size - 1;
+    gf->prev   = (uint32_t*)malloc((size_t)block_size * sizeof(uint32_t));
+    gf->head   = (uint32_t*)malloc((size_t)size * sizeof(uint32_t));
+    gf->stamps = (uint32_t*)calloc(size, sizeof(uint32_t));
+    if (!gf->prev || !gf->head || !gf->stamps) {
+        fprintf(stderr, "Error allocating group finder\n");
+        exit(1);
+    }
+}
+
+static void group_finder_free(GroupFinder *gf) {
+    free(gf->prev);
+    free(gf->head);
+    free(gf->stamps);
+}
+
+static inline uint32_t group_hash(const GroupFinder *gf, const int32_t *d) {
+    uint32_t h = (uint32_t)d[0] * 0x9E3779B1u;
+    h = (h ^ (uint32_t)d[1]) * 0x85EBCA77u;
+    h = (h ^ (uint32_t)d[2]) * 0xC2B2AE3Du;
+    return h >> gf->shift;
+}
+
+static void group_finder_prepare(GroupFinder *gf, const int32_t *deltas, size_t n) {
+    if (++gf->stamp == 0) {
+        memset(gf->stamps, 0, ((size_t)gf->mask + 1) * sizeof(uint32_t));
+        gf->stamp = 1;
+    }
+    for (size_t i = 0; i + GROUP_MIN_LEN <= n; i++) {
+        uint32_t h = group_hash(gf, deltas + i);
+        gf->prev[i] = gf->stamps[h] == gf->stamp ? gf->head[h] : MATCH_NONE;
+        gf->stamps[h] = gf->stamp;
+        gf->head[h] = (uint32_t)i;
+    }
+}
+
+// Quantos valores de a e b coincidem desde o início, até max
+static inline uint32_t group_match_len(const int32_t *a, const int32_t *b, uint32_t max) {
+    uint32_t len = 0;
+    for (; len + 8 <= max; len += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(a + len)),
+                                        _mm256_loadu_si256((const __m256i*)(b + len)));
+        unsigned diff = ~(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(eq)) & 0xFF;
+        if (diff) return len + (uint32_t)__builtin_ctz(diff);
+    }
+    while (len < max && a[len] == b[len]) len++;
+    return len;
+}
+
+// Maior grupo que começa em i; devolve N (0 se menor que GROUP_MIN_LEN) e a distância
+static uint32_t group_find(const GroupFinder *gf, const int32_t *deltas, uint32_t i,
+                           uint32_t n, uint32_t *dist) {
+    if (i + GROUP_MIN_LEN > n) return 0;
+    uint32_t max = (uint32_t)n - i, best = 0;
+    uint32_t j = gf->prev[i];
+    for (int chain = 0; j != MATCH_NONE && chain < GROUP_MAX_CHAIN; j = gf->prev[j], chain++) {
+        uint32_t len = group_match_len(deltas + j, deltas + i, max);
+        if (len > best) {
+            best = len;
+            *dist = i - j;
+            if (len == max) break;
+        }
+    }
+    return best >= GROUP_MIN_LEN ? best : 0;
+}
+
+// Parse guloso: o grupo compensa se custar menos que os mesmos resíduos
+// como valores simples, com o k atual
+static int group_pays(const RiceBuffer *rb, const int32_t *deltas, size_t i,
+                      uint32_t len, uint32_t dist) {
+    TokenCost tc = { rb->binary, rb->groups, NULL, residual_k(rb->mean16) };
+    unsigned group = token_cost(&tc, 0, (int32_t)dist, '(', len), plain = 0;
+    for (uint32_t j = 0; j < len && plain <= group; j++)
+        plain += token_cost(&tc, 0, deltas[i + j], '\0', 0);
+    return group < plain;
+}
+
+// ============================================================================
+// COMPRESSÃO COM DELTA
+// ============================================================================
+
+static void compactar_bloco(RiceBuffer *rice_out, const int32_t *deltas,
+                            size_t delta_count, int enable_loop_compression,
+                            const MatchFinder *mf, const GroupFinder *gf, ParseStats *st) {
+    size_t i = 0;
+
+    while (i < delta_count) {
         int32_t atual = deltas[i];
         
         // 1. Tenta repetição IMEDIATA (^)
-        size_t count = 1;
-        while (i + count < delta_count && deltas[i + count] == atual) {
-            count++;
+        size_t count = run_length(deltas, i, delta_count);
+
+        // Grupo '(' quando cobre mais que a run e sai mais barato
+        if (gf) {
+            uint32_t dist = 0;
+            uint32_t len = group_find(gf, deltas, (uint32_t)i, (uint32_t)delta_count, &dist);
+            if (len > count && group_pays(rice_out, deltas, i, len, dist)) {
+                rice_write_token(rice_out, (int32_t)dist, '(', len);
+                st->group_tokens++;
+                st->group_samples += len;
+                i += len;
+                continue;
+            }
         }
 
         if (count >= 2) {
-            rice_write_token(&rice_out, atual, '^', count);
+            rice_write_token(rice_out, atual, '^', count);
             i += count;
             continue;
         }
 
-        // 2. Tenta Sniper (~) com Look-ahead de 100 samples usando AVX2
+        // 2. Tenta Sniper (~) com Look-ahead de mf->window samples
         int sniper_found = 0;
-        if (!td->enable_loop_compression) {
-            rice_write_token(&rice_out, atual, '\0', 0);
+        if (!enable_loop_compression) {
+            rice_write_token(rice_out, atual, '\0', 0);
             i++;
             continue;
         }
-        int janela = 100; // O "100 à frente" que você pediu
-        int limite_busca = (i + janela < delta_count) ? i + janela : delta_count - 1;
+        int limite_busca = (i + mf->window < delta_count) ? i + mf->window : delta_count - 1;
 
         // Procura a primeira aparição do valor 'atual' no futuro próximo (mínimo dist 2)
-        int found_idx = find_next_match_avx2(deltas, i + 2, limite_busca, atual);
+        int found_idx = match_first(mf, deltas, (int)i, limite_busca);
+        st->sniper_lookups++;
 
         if (found_idx != -1) {
             int dist = found_idx - i;
+            st->sniper_found++;
             
             // --- CHECAGEM DE EFICIÊNCIA ---
             // Verificamos se dentro desse "buraco" do sniper existe alguma repetição (^)
             // Se existir, é melhor NÃO usar o sniper agora para não quebrar a repetição futura.
-            int rep_no_caminho = 0;
-            for (int j = i + 1; j < found_idx - 1; j++) {
-                if (deltas[j] == deltas[j + 1]) {
-                    rep_no_caminho = 1;
-                    break;
-                }
-            }
+            int rep_no_caminho = mf->rep_after[i + 1] + 1 < (uint32_t)found_idx;
 
             if (!rep_no_caminho) {
                 // Aplica o Sniper: Valor~Distancia,
-                rice_write_token(&rice_out, atual, '~', (uint64_t)(dist - 1));
+                rice_write_token(rice_out, atual, '~', (uint64_t)(dist - 1));
                 
                 // Escreve os valores que ficaram no meio
                 for (int j = i + 1; j < found_idx; j++) {
-                    rice_write_token(&rice_out, deltas[j], '\0', 0);
+                    rice_write_token(rice_out, deltas[j], '\0', 0);
                 }
                 
                 i = found_idx + 1; // Pula para depois do valor encontrado
                 sniper_found = 1;
+                st->sniper_used++;
             }
         }
 
         // 3. Fallback: Se nada funcionou, escreve o valor simples
         if (!sniper_found) {
-            rice_write_token(&rice_out, atual, '\0', 0);
+            rice_write_token(rice_out, atual, '\0', 0);
             i++;
         }
     }
-    rice_writer_finish(&rice_out);
-    
-    printf("  [Channel %d] Compressed: %zu bytes (4-bit delta + rice)\n", td->channel_id, out->byte_count);
+}
+
+// ============================================================================
+// PARSE ÓTIMO POR CUSTO (--parse optimal)
+// Programação dinâmica de trás para frente sobre o bloco: em cada posição o
+// custo mínimo até o fim entre valor simples, run '^' até o fim da repetição e
+// sniper '~' para cada reaparição do valor na janela do --window (no máximo
+// MATCH_MAX_CHAIN candidatos, como a cadeia limitada de um LZ) e, com
+// --groups, o maior grupo '(' que começa ali.
+// O custo de cada token é o tamanho exato do código: no modo binário com o k
+// que a média móvel teria ali se cada amostra fosse um token (o caso comum),
+// no texto com a tabela Rice(k=1) como estimativa (o k do bloco só é escolhido depois,
+// pelo histograma dos símbolos). O buraco do sniper é parseado sem snipers internos: cada run
+// máxima dentro dele vira '^' ou valores simples, o que custar menos, e o
+// custo de qualquer buraco sai em O(1) de somas de prefixo sobre as runs.
+// ============================================================================
+#define PARSE_GREEDY  0
+#define PARSE_OPTIMAL 1
+
+#define PARSE_PLAIN  0
+#define PARSE_RUN    1
+#define PARSE_SNIPER 2
+#define PARSE_GROUP  3
+
+typedef struct {
+    uint32_t *run_start;  // início da run máxima que contém i
+    uint32_t *run_end;    // fim (exclusivo) dessa run
+    uint32_t *pre_cost;   // custo das runs inteiras antes da run de i
+    uint32_t *pre_count;  // tokens dessas runs
+    uint32_t *best;       // custo mínimo de i até o fim do bloco
+    uint32_t *target;     // sniper: posição da âncora; grupo: distância
+    uint32_t *length;     // grupo: N
+    uint8_t  *kind;       // PARSE_PLAIN / PARSE_RUN / PARSE_SNIPER / PARSE_GROUP
+    uint8_t  *k;          // modo binário: k estimado em cada posição
+} ParseScratch;
+
+// Trecho de 'len' valores iguais a partir de pos dentro de um buraco: run ou
+// valores simples
+static inline int piece_is_run(const TokenCost *tc, uint32_t pos, int32_t value, uint32_t len,
+                               unsigned *bits, unsigned *tokens) {
+    unsigned plain = len * token_cost(tc, pos, value, '\0', 0);
+    if (len >= 2) {
+        unsigned run = token_cost(tc, pos, value, '^', len);
+        if (run < plain) { *bits = run; *tokens = 1; return 1; }
+    }
+    *bits = plain;
+    *tokens = len;
+    return 0;
+}
+
+// Custo e número de tokens do buraco [a, b)
+static void gap_cost(const ParseScratch *ps, const TokenCost *tc, const int32_t *deltas,
+                     uint32_t a, uint32_t b, unsigned *bits, unsigned *tokens) {
+    unsigned cb, ct;
+    uint32_t first_end = ps->run_end[a];
+    if (first_end >= b) {
+        piece_is_run(tc, a, deltas[a], b - a, bits, tokens);
+        return;
+    }
+    uint32_t last = ps->run_start[b - 1];
+    piece_is_run(tc, a, deltas[a], first_end - a, bits, tokens);
+    piece_is_run(tc, last, deltas[last], b - last, &cb, &ct);
+    *bits   += cb + ps->pre_cost[b - 1] - ps->pre_cost[first_end];
+    *tokens += ct + ps->pre_count[b - 1] - ps->pre_count[first_end];
+}
+
+static void compactar_bloco_otimo(RiceBuffer *rice_out, const int32_t *deltas, size_t n,
+                                  int enable_loop_compression, const ParseScratch *ps,
+                                  const MatchFinder *mf, const GroupFinder *gf, ParseStats *st) {
+    if (n == 0) return;
+    TokenCost tc = { rice_out->binary, rice_out->groups, ps->k, 0 };
+    if (tc.binary) {
+        uint64_t mean16 = rice_out->mean16;
+        for (size_t i = 0; i < n; i++) {
+            ps->k[i] = (uint8_t)residual_k(mean16);
+            mean16 += zigzag32(deltas[i]) - (mean16 >> 4);
+        }
+    }
+
+    // Runs máximas e somas de prefixo do custo delas como trecho de buraco
+    uint32_t cost_acc = 0, count_acc = 0;
+    for (uint32_t i = 0; i < n;) {
+        uint32_t end = i + (uint32_t)run_length(deltas, i, n);
+        unsigned bits, tokens;
+        piece_is_run(&tc, i, deltas[i], end - i, &bits, &tokens);
+        for (uint32_t j = i; j < end; j++) {
+            ps->run_start[j] = i;
+            ps->run_end[j]   = end;
+            ps->pre_cost[j]  = cost_acc;
+            ps->pre_count[j] = count_acc;
+        }
+        cost_acc  += bits;
+        count_acc += tokens;
+        i = end;
+    }
+
+    ps->best[n] = 0;
+    for (uint32_t i = (uint32_t)n; i-- > 0;) {
+        int32_t v = deltas[i];
+        uint32_t best = token_cost(&tc, i, v, '\0', 0) + ps->best[i + 1];
+        uint8_t kind = PARSE_PLAIN;
+
+        uint32_t end = ps->run_end[i];
+        if (end - i >= 2) {
+            uint32_t c = token_cost(&tc, i, v, '^', end - i) + ps->best[end];
+            if (c < best) { best = c; kind = PARSE_RUN; }
+        }
+
+        if (enable_loop_compression && i + 2 < n) {
+            int limit = (int)(i + mf->window < n ? i + mf->window : n - 1);
+            int chain = 0;
+            int j = match_first(mf, deltas, (int)i, limit);
+            st->sniper_lookups++;
+            if (j != -1) st->sniper_found++;
+            for (; j != -1 && chain < MATCH_MAX_CHAIN; j = match_following(mf, deltas, j, limit), chain++) {
+                unsigned gbits, gtokens;
+                gap_cost(ps, &tc, deltas, i + 1, (uint32_t)j, &gbits, &gtokens);
+                uint32_t c = token_cost(&tc, i, v, '~', gtokens) + gbits + ps->best[j + 1];
+                if (c < best) { best = c; kind = PARSE_SNIPER; ps->target[i] = (uint32_t)j; }
+            }
+        }
+
+        if (gf) {
+            uint32_t dist = 0, len = group_find(gf, deltas, i, (uint32_t)n, &dist);
+            if (len) {
+                uint32_t c = token_cost(&tc, i, (int32_t)dist, '(', len) + ps->best[i + len];
+                if (c < best) { best = c; kind = PARSE_GROUP; ps->target[i] = dist; ps->length[i] = len; }
+            }
+        }
+        ps->best[i] = best;
+        ps->kind[i] = kind;
+    }
+
+    for (uint32_t i = 0; i < n;) {
+        int32_t v = deltas[i];
+        if (ps->kind[i] == PARSE_PLAIN) {
+            rice_write_token(rice_out, v, '\0', 0);
+            i++;
+        } else if (ps->kind[i] == PARSE_RUN) {
+            rice_write_token(rice_out, v, '^', ps->run_end[i] - i);
+            i = ps->run_end[i];
+        } else if (ps->kind[i] == PARSE_GROUP) {
+            rice_write_token(rice_out, (int32_t)ps->target[i], '(', ps->length[i]);
+            st->group_tokens++;
+            st->group_samples += ps->length[i];
+            i += ps->length[i];
+        } else {
+            uint32_t j = ps->target[i];
+            unsigned gbits, gtokens;
+            gap_cost(ps, &tc, deltas, i + 1, j, &gbits, &gtokens);
+            rice_write_token(rice_out, v, '~', gtokens);
+            st->sniper_used++;
+            for (uint32_t p = i + 1; p < j;) {
+                uint32_t len = (ps->run_end[p] < j ? ps->run_end[p] : j) - p;
+                unsigned bits, tokens;
+                if (piece_is_run(&tc, p, deltas[p], len, &bits, &tokens)) {
+                    rice_write_token(rice_out, deltas[p], '^', len);
+                } else {
+                    for (uint32_t q = 0; q < len; q++) rice_write_token(rice_out, deltas[p], '\0', 0);
+                }
+                p += len;
+            }
+            i = j + 1;
+        }
+    }
+}
+
+// Parse + Rice dos resíduos de um bloco em rb. Devolve o byte de parâmetro do
+// header: o k escolhido no texto, o k inicial k0 no binário.
+static unsigned codificar_tokens(const SegmentTask *td, RiceBuffer *rb, const int32_t *deltas,
+                                 size_t n, unsigned k0, const MatchFinder *mf,
+                                 const GroupFinder *gf, const ParseScratch *ps, ParseStats *st) {
+    if (td->binary) rb->mean16 = (uint64_t)16 << k0;
+    if (td->parse == PARSE_OPTIMAL)
+        compactar_bloco_otimo(rb, deltas, n, td->enable_loop_compression, ps, mf, gf, st);
+    else
+        compactar_bloco(rb, deltas, n, td->enable_loop_compression, mf, gf, st);
+    return td->binary ? k0 : rice_flush_symbols(rb);
+}
+
+// Comprime um segmento (blocos consecutivos de um canal) para o buffer
+// próprio do segmento. main costura os segmentos em ordem ao gravar.
+void compactar_segmento_task(void *arg) {
+    SegmentTask *td = (SegmentTask*)arg;
+    Channel *ch = td->channel;
+    Binary4BitBuffer *out = td->output;
+    RiceBuffer rice_out;
+    Binary4BitBuffer pending;
+
+    int32_t *deltas  = (int32_t*)malloc(td->block_size * sizeof(int32_t));
+    int32_t *scratch = (int32_t*)malloc(td->block_size * sizeof(int32_t));
+    int32_t *shifted = (int32_t*)malloc(td->block_size * sizeof(int32_t));
+    if (!deltas || !scratch || !shifted) {
+        fprintf(stderr, "Error allocating delta buffer\n");
+        exit(1);
+    }
+    Predictor pred;
+    int16_t *lms_hist = NULL, *lms_sgn = NULL;
+    if (td->best) {
+        lms_hist = (int16_t*)malloc((td->block_size + LMS_MAX_ORDER) * sizeof(int16_t));
+        lms_sgn  = (int16_t*)malloc((td->block_size + LMS_MAX_ORDER) * sizeof(int16_t));
+        if (!lms_hist || !lms_sgn) {
+            fprintf(stderr, "Error allocating LMS buffers\n");
+            exit(1);
+        }
+    }
+    ParseScratch ps = {0};
+    if (td->parse == PARSE_OPTIMAL) {
+        size_t cap = (size_t)td->block_size + 1;
+        ps.run_start = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        ps.run_end   = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        ps.pre_cost  = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        ps.pre_count = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        ps.best      = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        ps.target    = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        ps.length    = (uint32_t*)malloc(cap * sizeof(uint32_t));
+        ps.kind      = (uint8_t*)malloc(cap);
+        ps.k         = (uint8_t*)malloc(cap);
+        if (!ps.run_start || !ps.run_end || !ps.pre_cost || !ps.pre_count ||
+            !ps.best || !ps.target || !ps.length || !ps.kind || !ps.k) {
+            fprintf(stderr, "Error allocating parse buffers\n");
+            exit(1);
+        }
+    }
+    MatchFinder mf;
+    match_finder_init(&mf, td->window,
+                      td->parse == PARSE_OPTIMAL || td->window > MATCH_SCAN_LIMIT, td->block_size);
+    GroupFinder gf;
+    Binary4BitBuffer groups_out = {0};
+    if (td->groups) {
+        group_finder_init(&gf, td->block_size);
+        init_4bit_buffer(&groups_out, (size_t)td->block_size * 2);
+    }
+    init_4bit_buffer(&pending, td->binary ? 1 : (size_t)td->block_size * 4);
+
+    out->byte_count = 0;
+    td->sniper_lookups = td->sniper_found = td->sniper_used = 0;
+    td->group_tokens = td->group_samples = 0;
+    td->constant_blocks = td->wasted_blocks = 0;
+    for (uint32_t b = 0; b < td->block_count; b++) {
+        uint64_t first = (uint64_t)(td->first_block + b) * td->block_size;
+        size_t n = 0;
+        if (first < ch->count) {
+            n = ch->count - first < td->block_size ? ch->count - first : td->block_size;
+        }
+
+        // Bloco constante (silêncio, DC): só o tipo, o valor e o modo
+        // estéreo, sem preditor nem tokens
+        size_t block_start = out->byte_count;
+        if (n > 0 && run_length(ch->samples + first, 0, n) == n) {
+            int32_t v = ch->samples[first];
+            ensure_4bit_capacity(out, 6);
+            out->data[out->byte_count++] = TXAC_BLOCK_CONSTANT;
+            for (int byte = 0; byte < 4; byte++) out->data[out->byte_count++] = (uint8_t)((uint32_t)v >> (8 * byte));
+            if (td->stereo_modes) out->data[out->byte_count++] = td->stereo_modes[td->first_block + b];
+            td->constant_blocks++;
+            td->blocks[b].sample_index = td->first_sample + first;
+            td->blocks[b].byte_offset  = block_start;
+            td->blocks[b].bit_size     = (uint32_t)((out->byte_count - block_start) * 8);
+            td->blocks[b].sample_count = (uint32_t)n;
+            continue;
+        }
+
+        // Bits desperdiçados saem antes da predição; o decoder devolve o
+        // deslocamento depois de restaurar o preditor
+        const int32_t *src = ch->samples + first;
+        unsigned wasted = wasted_bits(src, n);
+        if (wasted) {
+            shift_samples(src, n, wasted, shifted);
+            src = shifted;
+        }
+        choose_predictor(src, n, &pred, deltas, scratch);
+        pred.wasted = (uint8_t)wasted;
+        if (wasted) td->wasted_blocks++;
+        unsigned lms_stages = td->best ? lms_try_block(deltas, n, scratch, lms_hist, lms_sgn) : 0;
+
+        // Debug: mostra primeiros resíduos
+        if (td->verbose && b == 0 && n >= 10) {
+            printf("   [Channel %d] Predictor %s order %u, first residuals: %d, %d, %d, %d, %d...\n",
+                   td->channel_id, pred.lpc ? "LPC" : "fixed", pred.order,
+                   deltas[0], deltas[1], deltas[2], deltas[3], deltas[4]);
+        }
+
+        // Cada bloco começa alinhado em byte: 1 byte de tipo, 1 byte com o
+        // parâmetro Rice (k dos símbolos de texto, ou k inicial no modo binário),
+        // o preditor do bloco, no --best os estágios LMS aplicados e, nos
+        // canais da esquerda de um par, o modo estéreo
+        size_t pred_size = predictor_header_size(&pred);
+        ensure_4bit_capacity(out, 4 + pred_size);
+        out->data[out->byte_count++] = TXAC_BLOCK_TOKENS;
+        out->data[out->byte_count++] = 0;
+        predictor_write_header(&pred, out->data + out->byte_count);
+        out->byte_count += pred_size;
+        if (td->best) out->data[out->byte_count++] = (uint8_t)lms_stages;
+        if (td->stereo_modes) out->data[out->byte_count++] = td->stereo_modes[td->first_block + b];
+
+        size_t tokens_start = out->byte_count;
+        unsigned k0 = td->binary ? estimate_initial_k(deltas, n) : 0;
+        ParseStats st = {0};
+        if (td->enable_loop_compression) match_finder_prepare(&mf, deltas, n);
+        rice_writer_init(&rice_out, out, &pending, td->binary, 0);
+        out->data[block_start + 1] =
+            (uint8_t)codificar_tokens(td, &rice_out, deltas, n, k0, &mf, NULL, &ps, &st);
+
+        // --groups: o bloco é codificado de novo com grupos e fica a versão
+        // menor; só ela paga o bit de run/grupo (TXAC_BLOCK_GROUPS)
+        if (td->groups) {
+            ParseStats st_groups = {0};
+            RiceBuffer rice_groups;
+            group_finder_prepare(&gf, deltas, n);
+            rice_writer_init(&rice_groups, &groups_out, &pending, td->binary, 1);
+            unsigned k = codificar_tokens(td, &rice_groups, deltas, n, k0, &mf, &gf, &ps, &st_groups);
+            if (st_groups.group_tokens &&
+                groups_out.byte_count * 8 + rice_groups.bit_count <
+                (out->byte_count - tokens_start) * 8 + rice_out.bit_count) {
+                out->byte_count = tokens_start;
+                ensure_4bit_capacity(out, groups_out.byte_count);
+                memcpy(out->data + out->byte_count, groups_out.data, groups_out.byte_count);
+                out->byte_count += groups_out.byte_count;
+                rice_out.bits      = rice_groups.bits;
+                rice_out.bit_count = rice_groups.bit_count;
+                out->data[block_start]     = TXAC_BLOCK_GROUPS;
+                out->data[block_start + 1] = (uint8_t)k;
+                st = st_groups;
+            }
+            groups_out.byte_count = 0;
+        }
+        td->sniper_lookups += st.sniper_lookups;
+        td->sniper_found   += st.sniper_found;
+        td->sniper_used    += st.sniper_used;
+        td->group_tokens   += st.group_tokens;
+        td->group_samples  += st.group_samples;
+
+        td->blocks[b].sample_index = td->first_sample + first;
+        td->blocks[b].byte_offset  = block_start;
+        td->blocks[b].bit_size     = (uint32_t)((out->byte_count - block_start) * 8 + rice_out.bit_count);
+        td->blocks[b].sample_count = (uint32_t)n;
+        rice_writer_finish(&rice_out);
+    }
     
     free(deltas);
-    return NULL;
-}  
+    free(scratch);
+    free(shifted);
+    free(lms_hist);
+    free(lms_sgn);
+    match_finder_free(&mf);
+    if (td->groups) group_finder_free(&gf);
+    free(groups_out.data);
+    free(ps.run_start);
+    free(ps.run_end);
+    free(ps.pre_cost);
+    free(ps.pre_count);
+    free(ps.best);
+    free(ps.target);
+    free(ps.length);
+    free(ps.kind);
+    free(ps.k);
+    free(pending.data);
+}
 
 // ============================================================================
 // MAIN
@@ -506,108 +2342,401 @@ while (i < delta_count) {
 
 int main(int argc, char **argv) {
     if (argc < 3) {
-        printf("\nUsage: %s <input> <output.txac> [--loop]\n", argv[0]);
+        printf("\nUsage: %s <input> <output.txac> [--loop] [--text] [--best] [--native] [--parse greedy|optimal] [--window N] [--groups] [--couple none|A-B,...] [--block N] [--memory MB] [--threads N] [--stats]\n", argv[0]);
         return 1;
     }
 
     const char *input = argv[1];
     const char *output = argv[2];
-    int enable_loop = (argc >= 4 && strcmp(argv[3], "--loop") == 0);
+    int enable_loop = 0;
+    int binary = 1;
+    int best = 0;
+    int show_stats = 0;
+    const char *couple = NULL;  // NULL = pares vizinhos (0-1, 2-3, ...)
+    int parse = PARSE_GREEDY;
+    int window = SNIPER_WINDOW_DEFAULT;
+    int groups = 0;
+    int native = 0;
+    uint32_t block_size = DEFAULT_BLOCK_SIZE;
+    uint64_t memory_mb = DEFAULT_MEMORY_MB;
+    int num_threads = detect_cpu_count();
+
+    for (int a = 3; a < argc; a++) {
+        if (strcmp(argv[a], "--loop") == 0) {
+            enable_loop = 1;
+        } else if (strcmp(argv[a], "--text") == 0) {
+            binary = 0;
+        } else if (strcmp(argv[a], "--best") == 0) {
+            best = 1;
+        } else if (strcmp(argv[a], "--groups") == 0) {
+            groups = 1;
+        } else if (strcmp(argv[a], "--native") == 0) {
+            native = 1;
+        } else if (strcmp(argv[a], "--stats") == 0) {
+            show_stats = 1;
+        } else if (strcmp(argv[a], "--parse") == 0 && a + 1 < argc) {
+            const char *mode = argv[++a];
+            if (strcmp(mode, "greedy") == 0) {
+                parse = PARSE_GREEDY;
+            } else if (strcmp(mode, "optimal") == 0) {
+                parse = PARSE_OPTIMAL;
+            } else {
+                fprintf(stderr, "Error: --parse must be greedy or optimal\n");
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--window") == 0 && a + 1 < argc) {
+            long v = strtol(argv[++a], NULL, 10);
+            if (v < 2 || v > SNIPER_WINDOW_MAX) {
+                fprintf(stderr, "Error: --window must be between 2 and %d samples\n", SNIPER_WINDOW_MAX);
+                return 1;
+            }
+            window = (int)v;
+        } else if (strcmp(argv[a], "--couple") == 0 && a + 1 < argc) {
+            couple = argv[++a];
+        } else if (strcmp(argv[a], "--block") == 0 && a + 1 < argc) {
+            long v = strtol(argv[++a], NULL, 10);
+            if (v < 16 || v > (1 << 20)) {
+                fprintf(stderr, "Error: --block must be between 16 and %d samples\n", 1 << 20);
+                return 1;
+            }
+            block_size = (uint32_t)v;
+        } else if (strcmp(argv[a], "--memory") == 0 && a + 1 < argc) {
+            long v = strtol(argv[++a], NULL, 10);
+            if (v < 1) {
+                fprintf(stderr, "Error: --memory must be at least 1 MB\n");
+                return 1;
+            }
+            memory_mb = (uint64_t)v;
+        } else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) {
+            long v = strtol(argv[++a], NULL, 10);
+            if (v < 1 || v > 1024) {
+                fprintf(stderr, "Error: --threads must be between 1 and 1024\n");
+                return 1;
+            }
+            num_threads = (int)v;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[a]);
+            return 1;
+        }
+    }
 
     printf("\n=== TXAC Encoder v0.3.1 (Delta Encoding) ===\n");
-
-    char temp_wav[256] = {0};
-    int is_temp = 0;
-
-    if (precisa_converter(input)) {
-        if (!convert_to_wav_temp(input, temp_wav)) return 1;
-        input = temp_wav;
-        is_temp = 1;
+    if (__builtin_cpu_supports("avx512f")) {
+        find_next_match = find_next_match_avx512;
+        run_length_simd = run_length_avx512;
     }
+    clock_t start_clock = clock();
 
-    Channel channels[MAX_CHANNELS];
     TXACHeader header = {0};
+    WavReader reader = {0};
     
-    if (!ler_wav_multicanal(input, channels, &header)) {
-        if (is_temp) remove(temp_wav);
+    if (!(precisa_converter(input) ? abrir_wav_ffmpeg(input, &reader, &header)
+                                   : abrir_wav_multicanal(input, &reader, &header)))
         return 1;
+    if (native && reader.is_float) {
+        // Float não tem inteiros a preservar: segue na escala padrão de -110 dB
+        printf("Float input: --native needs integer PCM, using the -110 dB scale\n");
+        native = 0;
+    }
+    reader.native = native;
+
+    // Tamanho da janela a partir do orçamento: por quadro e canal guardamos a
+    // amostra int32 e, em média, bem menos que 8 bytes de saída comprimida.
+    size_t bytes_per_frame = (size_t)header.channels * (sizeof(int32_t) + 8);
+    uint64_t window_frames = memory_mb * 1024 * 1024 / bytes_per_frame;
+    window_frames -= window_frames % block_size;
+    if (window_frames < block_size) window_frames = block_size;
+    uint32_t window_blocks = (uint32_t)(window_frames / block_size);
+
+    // Pares acoplados: bit i da máscara = canais i e i+1
+    uint32_t pair_mask = 0;
+    if (!couple) {
+        for (int i = 0; i + 1 < header.channels; i += 2) pair_mask |= 1u << i;
+    } else if (strcmp(couple, "none") != 0) {
+        for (const char *p = couple; *p;) {
+            char *end;
+            long l = strtol(p, &end, 10), r = -1;
+            if (*end == '-') r = strtol(end + 1, &end, 10);
+            if (r != l + 1 || l < 0 || r >= header.channels || (*end && *end != ',') ||
+                (pair_mask & (3u << l)) || (l > 0 && (pair_mask & (1u << (l - 1))))) {
+                fprintf(stderr, "Error: --couple takes pairs of neighbouring channels, e.g. 0-1,4-5\n");
+                fechar_wav_multicanal(&reader);
+                return 1;
+            }
+            pair_mask |= 1u << l;
+            p = *end ? end + 1 : end;
+        }
     }
 
-    printf("\nCompressing %d channels with delta encoding...\n", header.channels);
-    
-    pthread_t threads[MAX_CHANNELS];
-    ThreadData thread_data[MAX_CHANNELS];
-    Binary4BitBuffer outputs[MAX_CHANNELS];
+    if (native)
+        printf("\nNative %u-bit integers: no gain, bit-exact round trip\n", header.bits_per_sample);
+    printf("\nCompressing %d channels with delta encoding (window: %llu frames, %llu MB budget, %d threads)...\n",
+           header.channels, (unsigned long long)window_frames, (unsigned long long)memory_mb, num_threads);
     
-    for (int i = 0; i < header.channels; i++) {
-        thread_data[i].channel = &channels[i];
-        thread_data[i].output = &outputs[i];
-        thread_data[i].channel_id = i;
-        thread_data[i].enable_loop_compression = enable_loop;
-        
-        pthread_create(&threads[i], NULL, compactar_canal_4bit_thread, &thread_data[i]);
+    ThreadPool pool;
+    pool_init(&pool, num_threads);
+
+    // Cada canal da janela é cortado em segmentos de blocos inteiros; no pior
+    // caso (1 bloco por segmento) há window_blocks segmentos por canal.
+    size_t max_tasks = (size_t)window_blocks * header.channels;
+    SegmentTask *tasks = (SegmentTask*)calloc(max_tasks, sizeof(SegmentTask));
+    Binary4BitBuffer *seg_outputs = (Binary4BitBuffer*)calloc(max_tasks, sizeof(Binary4BitBuffer));
+    Channel channels[MAX_CHANNELS];
+    TXACBlockEntry *window_blocks_buf = (TXACBlockEntry*)calloc((size_t)window_blocks * header.channels,
+                                                                sizeof(TXACBlockEntry));
+    CouplingTask *coupling = (CouplingTask*)calloc(max_tasks, sizeof(CouplingTask));
+    uint8_t *window_modes = (uint8_t*)calloc((size_t)window_blocks * header.channels, 1);
+    uint64_t mode_count[4] = {0};
+    uint64_t sniper_lookups = 0, sniper_found = 0, sniper_used = 0;
+    uint64_t group_tokens = 0, group_samples = 0, constant_blocks = 0, wasted_blocks = 0;
+    // A tabela cresce com o arquivo (24 bytes por bloco), o áudio não
+    size_t table_count = 0, table_capacity = 1024;
+    TXACBlockEntry *table = (TXACBlockEntry*)malloc(table_capacity * sizeof(TXACBlockEntry));
+    if (!window_blocks_buf || !table || !tasks || !seg_outputs || !coupling || !window_modes) {
+        fprintf(stderr, "Error allocating block table\n");
+        fechar_wav_multicanal(&reader);
+        return 1;
+    }
+
+    // A janela nunca passa do áudio: arquivos curtos não reservam o orçamento todo
+    uint64_t channel_frames = window_frames;
+    if (reader.data_remaining != UINT64_MAX) {
+        uint64_t data_frames = reader.data_remaining / ((size_t)header.channels * (header.bits_per_sample / 8));
+        if (data_frames < channel_frames) channel_frames = data_frames > 0 ? data_frames : 1;
     }
-    
     for (int i = 0; i < header.channels; i++) {
-        pthread_join(threads[i], NULL);
+        init_channel(&channels[i], (size_t)channel_frames);
     }
 
-    printf("\nSaving TXAC file...\n");
     FILE *fout = fopen(output, "wb");
     if (!fout) {
         perror("Error creating file");
+        fechar_wav_multicanal(&reader);
         return 1;
     }
 
+    // Header provisório: total de amostras, blocos e offset da tabela são
+    // corrigidos no fim, quando o áudio inteiro já passou pela janela.
     fwrite(TXAC_MAGIC, 1, 4, fout);
     uint32_t version = TXAC_VERSION;
     fwrite(&version, 4, 1, fout);
     fwrite(&header.sample_rate, 4, 1, fout);
     fwrite(&header.channels, 2, 1, fout);
     
-    uint16_t save_bits = 32;
+    // --native guarda a profundidade real; sem ele as amostras já saem
+    // reduzidas de 110 dB em escala de 32 bits
+    uint16_t save_bits = native ? header.bits_per_sample : 32;
     fwrite(&save_bits, 2, 1, fout);
     
     uint32_t flags = enable_loop ? 1 : 0;
     flags |= (1 << 1); // Delta encoding flag
+    flags |= TXAC_FLAG_BLOCK_PARAMS | TXAC_FLAG_PREDICTOR;
+    if (binary) flags |= TXAC_FLAG_BINARY;
+    if (best) flags |= TXAC_FLAG_LMS;
+    if (pair_mask) flags |= TXAC_FLAG_STEREO;
+    if (groups) flags |= TXAC_FLAG_GROUPS;
+    flags |= TXAC_FLAG_CONSTANT;
+    if (native) flags |= TXAC_FLAG_NATIVE;
+    flags |= TXAC_FLAG_WASTED;
     fwrite(&flags, 4, 1, fout);
     fwrite(&header.total_samples, 8, 1, fout);
     
-    uint8_t reserved[36] = {0};
-    fwrite(reserved, 1, 36, fout);
-
-    long index_pos = ftell(fout);
-    uint64_t offsets[MAX_CHANNELS] = {0};
+    // Área antes reservada (36 bytes): descritor da tabela de blocos e
+    // máscara dos pares acoplados
+    uint32_t block_count = 0;
+    uint64_t table_offset = 0;
+    uint8_t reserved[16] = {0};
+    fwrite(&block_size, 4, 1, fout);
+    fwrite(&block_count, 4, 1, fout);
+    fwrite(&table_offset, 8, 1, fout);
+    fwrite(&pair_mask, 4, 1, fout);
+    fwrite(reserved, 1, 16, fout);
+
+    uint64_t pos = 64;
     uint64_t sizes[MAX_CHANNELS] = {0};
-    
-    for (int i = 0; i < header.channels; i++) {
-        fwrite(&offsets[i], 8, 1, fout);
-        fwrite(&sizes[i], 8, 1, fout);
-    }
+    size_t frames;
+
+    double read_secs = 0.0;
+    for (;;) {
+        clock_t read_start = clock();
+        frames = ler_wav_multicanal(&reader, channels, (size_t)window_frames);
+        read_secs += (double)(clock() - read_start) / CLOCKS_PER_SEC;
+        if (frames == 0) break;
+        uint32_t nblocks = (uint32_t)((frames + block_size - 1) / block_size);
+
+        // ~4 segmentos por worker para o roubo equilibrar a carga,
+        // independente de quantos canais o arquivo tem
+        size_t target_tasks = (size_t)num_threads * 4;
+        uint32_t seg_blocks = (uint32_t)(((size_t)nblocks * header.channels + target_tasks - 1) / target_tasks);
+        if (seg_blocks == 0) seg_blocks = 1;
+        uint32_t segs_per_channel = (nblocks + seg_blocks - 1) / seg_blocks;
+
+        // Primeiro o acoplamento dos pares, que reescreve as amostras dos
+        // dois canais; só depois a predição de cada canal
+        if (pair_mask) {
+            size_t t = 0;
+            for (int i = 0; i + 1 < header.channels; i++) {
+                if (!(pair_mask & (1u << i))) continue;
+                for (uint32_t first_block = 0; first_block < nblocks; first_block += seg_blocks, t++) {
+                    coupling[t].left = &channels[i];
+                    coupling[t].right = &channels[i + 1];
+                    coupling[t].modes = window_modes + (size_t)i * window_blocks;
+                    coupling[t].first_block = first_block;
+                    coupling[t].block_count = nblocks - first_block < seg_blocks ? nblocks - first_block : seg_blocks;
+                    coupling[t].block_size = block_size;
+                    pool_submit(&pool, acoplar_segmento_task, &coupling[t]);
+                }
+            }
+            pool_wait(&pool);
+            for (int i = 0; i + 1 < header.channels; i++)
+                if (pair_mask & (1u << i))
+                    for (uint32_t b = 0; b < nblocks; b++) mode_count[window_modes[(size_t)i * window_blocks + b]]++;
+        }
 
-    for (int i = 0; i < header.channels; i++) {
-        offsets[i] = ftell(fout);
-        fwrite(outputs[i].data, 1, outputs[i].byte_count, fout);
-        sizes[i] = outputs[i].byte_count;
+        for (int i = 0; i < header.channels; i++) {
+            for (uint32_t sgm = 0; sgm < segs_per_channel; sgm++) {
+                size_t t = (size_t)i * segs_per_channel + sgm;
+                uint32_t first_block = sgm * seg_blocks;
+                uint32_t count = nblocks - first_block < seg_blocks ? nblocks - first_block : seg_blocks;
+
+                if (!seg_outputs[t].data)
+                    init_4bit_buffer(&seg_outputs[t], (size_t)seg_blocks * block_size * 2);
+
+                tasks[t].channel = &channels[i];
+                tasks[t].output = &seg_outputs[t];
+                tasks[t].blocks = window_blocks_buf + (size_t)i * window_blocks + first_block;
+                tasks[t].first_sample = header.total_samples;
+                tasks[t].first_block = first_block;
+                tasks[t].block_size = block_size;
+                tasks[t].block_count = count;
+                tasks[t].channel_id = i;
+                tasks[t].enable_loop_compression = enable_loop;
+                tasks[t].binary = binary;
+                tasks[t].best = best;
+                tasks[t].parse = parse;
+                tasks[t].window = window;
+                tasks[t].groups = groups;
+                tasks[t].stereo_modes = (pair_mask & (1u << i)) ? window_modes + (size_t)i * window_blocks : NULL;
+                tasks[t].verbose = header.total_samples == 0 && sgm == 0;
+
+                pool_submit(&pool, compactar_segmento_task, &tasks[t]);
+            }
+        }
+        pool_wait(&pool);
+        for (size_t t = 0; t < (size_t)header.channels * segs_per_channel; t++) {
+            sniper_lookups += tasks[t].sniper_lookups;
+            sniper_found   += tasks[t].sniper_found;
+            sniper_used    += tasks[t].sniper_used;
+            group_tokens   += tasks[t].group_tokens;
+            group_samples  += tasks[t].group_samples;
+            constant_blocks += tasks[t].constant_blocks;
+            wasted_blocks   += tasks[t].wasted_blocks;
+        }
+
+        if (table_count + (size_t)nblocks * header.channels > table_capacity) {
+            while (table_count + (size_t)nblocks * header.channels > table_capacity)
+                table_capacity *= GROWTH_FACTOR;
+            TXACBlockEntry *grown = (TXACBlockEntry*)realloc(table, table_capacity * sizeof(TXACBlockEntry));
+            if (!grown) {
+                fprintf(stderr, "Error reallocating block table\n");
+                exit(1);
+            }
+            table = grown;
+        }
+
+        // Blocos gravados em ordem de tempo: bloco 0 de todos os canais, bloco 1...
+        // (costura dos segmentos: byte_offset ainda é relativo ao buffer do segmento)
+        for (uint32_t b = 0; b < nblocks; b++) {
+            for (int i = 0; i < header.channels; i++) {
+                TXACBlockEntry e = window_blocks_buf[(size_t)i * window_blocks + b];
+                Binary4BitBuffer *seg = &seg_outputs[(size_t)i * segs_per_channel + b / seg_blocks];
+                size_t bytes = (e.bit_size + 7) / 8;
+                fwrite(seg->data + e.byte_offset, 1, bytes, fout);
+                e.byte_offset = pos;
+                pos += bytes;
+                sizes[i] += bytes;
+                table[table_count++] = e;
+            }
+        }
+
+        header.total_samples += frames;
+        block_count += nblocks;
+        printf("\r  %.1f s encoded", header.sample_rate
+               ? (double)header.total_samples / header.sample_rate : 0.0);
+        fflush(stdout);
+    }
+    printf("\n");
+    if (!fechar_wav_multicanal(&reader)) {
+        fprintf(stderr, "Error converting FFmpeg\n");
+        fclose(fout);
+        remove(output);
+        return 1;
     }
 
-    fseek(fout, index_pos, SEEK_SET);
-    for (int i = 0; i < header.channels; i++) {
-        fwrite(&offsets[i], 8, 1, fout);
-        fwrite(&sizes[i], 8, 1, fout);
+    // Tabela de blocos no fim do arquivo: [bloco][canal]
+    table_offset = pos;
+    for (size_t i = 0; i < table_count; i++) {
+        fwrite(&table[i].sample_index, 8, 1, fout);
+        fwrite(&table[i].byte_offset, 8, 1, fout);
+        fwrite(&table[i].bit_size, 4, 1, fout);
+        fwrite(&table[i].sample_count, 4, 1, fout);
     }
 
+    fseek(fout, 20, SEEK_SET);
+    fwrite(&header.total_samples, 8, 1, fout);
+    fseek(fout, 32, SEEK_SET);
+    fwrite(&block_count, 4, 1, fout);
+    fwrite(&table_offset, 8, 1, fout);
+
     fclose(fout);
 
+    printf("Done reading: %llu samples per channel\n", (unsigned long long)header.total_samples);
     printf("\nChannel compression results:\n");
     for (int i = 0; i < header.channels; i++) {
         printf("  Channel %d: %llu bytes\n", i,
                (unsigned long long)sizes[i]);
         free(channels[i].samples);
-        free(outputs[i].data);
     }
-    
-    if (is_temp) remove(temp_wav);
+    pool_destroy(&pool);
+    for (size_t t = 0; t < max_tasks; t++) free(seg_outputs[t].data);
+    free(seg_outputs);
+    free(tasks);
+    free(window_blocks_buf);
+    free(coupling);
+    free(window_modes);
+    free(table);
+
+    if (show_stats) {
+        double secs = (double)(clock() - start_clock) / CLOCKS_PER_SEC;
+        uint64_t samples = header.total_samples * header.channels;
+        printf("\nStats: %llu frames, %llu bytes out, %.3f bits/sample, %.2f s CPU (%.1f Msamples/s), peak RSS %.1f MB\n",
+               (unsigned long long)header.total_samples, (unsigned long long)pos,
+               samples ? (double)pos * 8.0 / (double)samples : 0.0,
+               secs, secs > 0 ? (double)samples / secs / 1e6 : 0.0,
+               (double)peak_rss_bytes() / (1024.0 * 1024.0));
+        double pcm_mb = (double)samples * (header.bits_per_sample / 8) / (1024.0 * 1024.0);
+        printf("WAV read: %.2f s CPU (%.0f MB/s of PCM)\n",
+               read_secs, read_secs > 0 ? pcm_mb / read_secs : 0.0);
+        if (enable_loop)
+            printf("Sniper (window %d, %s): %llu lookups, %.1f%% matched, %.1f%% emitted\n",
+                   window, parse == PARSE_OPTIMAL || window > MATCH_SCAN_LIMIT ? "hash index"
+                         : find_next_match == find_next_match_avx512 ? "AVX-512 scan" : "AVX2 scan",
+                   (unsigned long long)sniper_lookups,
+                   sniper_lookups ? 100.0 * sniper_found / sniper_lookups : 0.0,
+                   sniper_lookups ? 100.0 * sniper_used / sniper_lookups : 0.0);
+        if (groups)
+            printf("Groups: %llu tokens covering %.2f%% of samples (mean length %.1f)\n",
+                   (unsigned long long)group_tokens,
+                   samples ? 100.0 * group_samples / samples : 0.0,
+                   group_tokens ? (double)group_samples / group_tokens : 0.0);
+        printf("Constant blocks: %llu of %llu, shifted (wasted bits): %llu\n",
+               (unsigned long long)constant_blocks, (unsigned long long)table_count,
+               (unsigned long long)wasted_blocks);
+        if (pair_mask)
+            printf("Stereo blocks: %llu L/R, %llu L/S, %llu S/R, %llu M/S\n",
+                   (unsigned long long)mode_count[0], (unsigned long long)mode_count[1],
+                   (unsigned long long)mode_count[2], (unsigned long long)mode_count[3]);
+    }
 
     printf("\nEncoding complete!\n");
     return 0;
@@ -1,7 +1,7 @@
 /*
-TXAC Decoder v4.0 - Multi-core, Rice/Golomb + Delta Decoding → WAV 32-bit
+TXAC Decoder v4.0 - Multi-core, Rice/Golomb + Delta Decoding → WAV 32-bit (16/24/32 com --native)
 - Lê formato TXAC v3+ (multicanal com header completo)
-- Decodificação Rice/Golomb (k=1) — substitui o antigo nibble-reader
+- Decodificação Rice/Golomb (k = 0..3 por bloco; k=1 sem flag bit 3) — substitui o antigo nibble-reader
 - Suporte a Delta Encoding (flag bit 1 do header)
 - MAX_CHANNELS expandido para 32
 - Buffers de decoders alocados dinamicamente
@@ -20,9 +20,19 @@ Uso:
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include <pthread.h>
 #include <immintrin.h>
 
+#if defined(_WIN32)
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 #define TXAC_MAGIC        "TXAC"
 #define MAX_CHANNELS      32
 #define GAIN_DB           110.0
@@ -48,6 +58,28 @@ typedef struct {
     uint64_t total_samples;
 } TXACHeader;
 
+/* Entrada da tabela de blocos (v5). Todo bloco começa com acumulador zerado. */
+typedef struct {
+    uint64_t sample_index;   /* primeira amostra do bloco dentro do canal */
+    uint64_t byte_offset;    /* posição absoluta no arquivo */
+    uint32_t bit_size;       /* header do bloco + Rice, em bits */
+    uint32_t sample_count;
+} TXACBlockEntry;
+
+#define TXAC_BLOCK_TOKENS 0  /* tipo de bloco: fluxo de tokens em Rice */
+#define TXAC_BLOCK_GROUPS 1  /* tipo de bloco: tokens com grupos '(' (TXAC_FLAG_GROUPS) */
+#define TXAC_BLOCK_CONSTANT 2  /* tipo de bloco: um único valor int32 (TXAC_FLAG_CONSTANT) */
+#define TXAC_FLAG_BINARY (1 << 2)  /* resíduos em Rice adaptativo, sem camada de texto */
+#define TXAC_FLAG_BLOCK_PARAMS (1 << 3)  /* 2º byte do bloco = parâmetro Rice do bloco */
+#define TXAC_FLAG_PREDICTOR (1 << 4)     /* header do bloco traz o preditor */
+#define TXAC_FLAG_LMS (1 << 5)           /* header do bloco traz os estágios LMS */
+#define TXAC_FLAG_STEREO (1 << 6)        /* pares acoplados: header do bloco traz o modo */
+#define TXAC_FLAG_GROUPS (1 << 7)        /* pode haver blocos TXAC_BLOCK_GROUPS */
+#define TXAC_FLAG_CONSTANT (1 << 8)      /* pode haver blocos TXAC_BLOCK_CONSTANT */
+#define TXAC_FLAG_NATIVE (1 << 9)        /* inteiros em bits_per_sample, sem o ganho de 110 dB */
+#define TXAC_FLAG_WASTED (1 << 10)       /* bit 6 do preditor: bits desperdiçados do bloco */
+#define RICE_MAX_K 3                     /* maior k dos símbolos de texto */
+
 /* ============================================================================
  * BUFFER INT32
  * ========================================================================== */
@@ -55,6 +87,7 @@ typedef struct {
     int32_t  *data;
     uint64_t  capacity;
     uint64_t  count;
+    int       fixed;   /* janela dentro de outro buffer: não cresce, descarta o excesso */
 } BufferInt32;
 
 static void init_buffer_int32(BufferInt32 *buf, uint64_t initial_capacity) {
@@ -68,7 +101,7 @@ static void init_buffer_int32(BufferInt32 *buf, uint64_t initial_capacity) {
 }
 
 static void ensure_buffer_capacity(BufferInt32 *buf, uint64_t required) {
-    if (buf->count + required < buf->capacity) return;
+    if (buf->fixed || buf->count + required < buf->capacity) return;
     uint64_t new_cap = buf->capacity * 2;
     while (buf->count + required >= new_cap) new_cap *= 2;
     int32_t *new_ptr = (int32_t *)realloc(buf->data, new_cap * sizeof(int32_t));
@@ -82,32 +115,93 @@ static void ensure_buffer_capacity(BufferInt32 *buf, uint64_t required) {
 
 static void push_value_int32(BufferInt32 *buf, int32_t value) {
     ensure_buffer_capacity(buf, 1);
+    if (buf->count >= buf->capacity) return;   /* só em buffers fixos */
     buf->data[buf->count++] = value;
 }
 
 /* ============================================================================
- * STREAM READER — Rice/Golomb com k=1  (igual ao txacplay v14)
+ * STREAM READER — Rice/Golomb com o k do bloco  (igual ao txacplay v14)
  *
  * O formato antigo (v3) usava nibble direto (byte_pos + nibble_pos).
  * O formato novo (v14) empacota cada símbolo com codificação de Golomb:
  *   1. Quociente unário: lê bits 1 até encontrar um 0  →  q
- *   2. Resto binário de k=1 bit                        →  r
- *   3. índice do símbolo = (q << 1) | r
+ *   2. Resto binário de k bits                         →  r
+ *   3. índice do símbolo = (q << k) | r
+ * O k vem do byte de parâmetro do bloco (flag bit 3); sem ele, k=1.
  * ========================================================================== */
 typedef struct {
     uint8_t *raw_data;
     size_t   byte_count;
+    size_t   bit_limit;    /* fim lógico do stream; blocos v5 não usam o padding */
     size_t   bit_pos;      /* cursor em bits; MSB first dentro de cada byte */
+    /* Caminho rápido: bit-buffer de 64 bits alinhado à esquerda, recarregado
+     * uma palavra por vez, e símbolos já decodificados pela tabela. */
+    uint64_t bit_buf;
+    unsigned bit_avail;
+    size_t   next_byte;
+    uint32_t pending_syms; /* 4 bits por símbolo, o próximo nos bits baixos */
+    unsigned pending_count;
+    unsigned rice_k;              /* k do bloco (texto) ou k inicial (binário) */
+    unsigned groups;              /* bloco TXAC_BLOCK_GROUPS (binário: s == 0 traz o bit run/grupo) */
+    const uint32_t *table;        /* tabela multi-símbolo do k atual */
 } Stream4Bit;
 
+static inline void stream_refill(Stream4Bit *s) {
+    if (s->next_byte + 8 <= s->byte_count) {
+        uint64_t word;
+        memcpy(&word, s->raw_data + s->next_byte, 8);
+        s->bit_buf |= __builtin_bswap64(word) >> s->bit_avail;
+        unsigned take = (63 - s->bit_avail) >> 3;
+        s->next_byte += take;
+        s->bit_avail += take * 8;
+    } else {
+        while (s->bit_avail <= 56 && s->next_byte < s->byte_count) {
+            s->bit_buf |= (uint64_t)s->raw_data[s->next_byte++] << (56 - s->bit_avail);
+            s->bit_avail += 8;
+        }
+    }
+}
+
+/* Realinha o bit-buffer com bit_pos depois de uma leitura bit a bit. */
+static void stream_resync(Stream4Bit *s) {
+    s->next_byte = s->bit_pos / 8;
+    s->bit_buf   = 0;
+    s->bit_avail = 0;
+    stream_refill(s);
+    unsigned skip = (unsigned)(s->bit_pos % 8);
+    s->bit_buf  <<= skip;
+    s->bit_avail -= skip;
+}
+
+#define RICE_TABLE_BITS 12
+#define RICE_TABLE_MAX_SYMS 6
+
+static uint32_t rice_table[RICE_MAX_K + 1][1 << RICE_TABLE_BITS];
+
 static void init_stream(Stream4Bit *s, uint8_t *data, size_t size) {
-    s->raw_data   = data;
-    s->byte_count = size;
-    s->bit_pos    = 0;
+    s->raw_data      = data;
+    s->byte_count    = size;
+    s->bit_limit     = size * 8;
+    s->bit_pos       = 0;
+    s->pending_syms  = 0;
+    s->pending_count = 0;
+    s->rice_k        = 1;           /* v4 e v5 sem TXAC_FLAG_BLOCK_PARAMS */
+    s->groups        = 0;
+    s->table         = rice_table[1];
+    stream_resync(s);
+}
+
+static void init_stream_bits(Stream4Bit *s, uint8_t *data, size_t bits) {
+    init_stream(s, data, (bits + 7) / 8);
+    s->bit_limit = bits;
+}
+
+static inline int stream_has_data(const Stream4Bit *s) {
+    return s->pending_count != 0 || s->bit_pos < s->bit_limit;
 }
 
 static inline int read_bit(Stream4Bit *s) {
-    if (s->bit_pos >= s->byte_count * 8) return -1;
+    if (s->bit_pos >= s->bit_limit) return -1;
     int byte_idx = (int)(s->bit_pos / 8);
     int bit_off  = 7 - (int)(s->bit_pos % 8);   /* MSB → LSB */
     int bit = (s->raw_data[byte_idx] >> bit_off) & 1;
@@ -125,10 +219,12 @@ static inline uint32_t read_bits(Stream4Bit *s, int count) {
     return value;
 }
 
-static char read_next_char(Stream4Bit *s) {
-    if (s->bit_pos >= s->byte_count * 8) return '\0';
+/* Decodificador de referência, bit a bit. Continua sendo usado no fim do
+ * stream e para códigos longos demais para a tabela (dados corrompidos). */
+static char read_next_char_bitwise(Stream4Bit *s) {
+    if (s->bit_pos >= s->bit_limit) return '\0';
 
-    const int k = 1;   /* deve ser o mesmo k do encoder */
+    const unsigned k = s->rice_k;   /* k do bloco, o mesmo do encoder */
 
     /* 1. Quociente unário */
     uint32_t q = 0;
@@ -145,6 +241,66 @@ static char read_next_char(Stream4Bit *s) {
     return simbolos[sym];
 }
 
+/* ============================================================================
+ * TABELA MULTI-SÍMBOLO
+ * Uma tabela por k (0..RICE_MAX_K), indexada pelos próximos RICE_TABLE_BITS
+ * bits do stream. Cada consulta devolve até 6 símbolos completos:
+ *   bits 0-3: comprimento total consumido   bits 4-6: quantidade de símbolos
+ *   bits 8+ : índices dos símbolos, 4 bits cada (o primeiro nos bits baixos)
+ * Entrada com comprimento 0 = código não cabe na janela → caminho bit a bit.
+ * ========================================================================== */
+static void init_rice_table_k(uint32_t *table, unsigned k) {
+    for (uint32_t idx = 0; idx < (1u << RICE_TABLE_BITS); idx++) {
+        unsigned used = 0, count = 0;
+        uint32_t syms = 0;
+        while (count < RICE_TABLE_MAX_SYMS) {
+            unsigned q = 0, pos = used;
+            while (pos < RICE_TABLE_BITS &&
+                   ((idx >> (RICE_TABLE_BITS - 1 - pos)) & 1)) { q++; pos++; }
+            if (pos + 1 + k > RICE_TABLE_BITS) break;   /* código incompleto */
+            pos++;                                      /* zero terminador */
+            uint32_t r = (idx >> (RICE_TABLE_BITS - pos - k)) & ((1u << k) - 1);
+            pos += k;
+            uint32_t sym = (q << k) | r;
+            if (sym >= 16) sym = 0;                     /* igual ao bit a bit: ',' */
+            syms |= sym << (4 * count);
+            count++;
+            used = pos;
+        }
+        table[idx] = count ? (used | (count << 4) | (syms << 8)) : 0;
+    }
+}
+
+static void init_rice_table(void) {
+    for (unsigned k = 0; k <= RICE_MAX_K; k++)
+        init_rice_table_k(rice_table[k], k);
+}
+
+static inline char read_next_char(Stream4Bit *s) {
+    if (s->pending_count == 0) {
+        if (s->bit_pos >= s->bit_limit) return '\0';
+        if (s->bit_avail < RICE_TABLE_BITS) stream_refill(s);
+
+        uint32_t e = s->table[s->bit_buf >> (64 - RICE_TABLE_BITS)];
+        unsigned len = e & 0xF;
+        if (len == 0 || len > s->bit_limit - s->bit_pos) {
+            char c = read_next_char_bitwise(s);
+            stream_resync(s);
+            return c;
+        }
+        s->bit_buf      <<= len;
+        s->bit_avail     -= len;
+        s->bit_pos       += len;
+        s->pending_syms   = e >> 8;
+        s->pending_count  = (e >> 4) & 7;
+    }
+
+    s->pending_count--;
+    char c = simbolos[s->pending_syms & 0xF];
+    s->pending_syms >>= 4;
+    return c;
+}
+
 typedef struct {
     int32_t  value;
     uint32_t argument;
@@ -159,26 +315,31 @@ static int read_token_stream(Stream4Bit *s, ParsedToken *token) {
     int negative = 0;
     int have_value = 0;
     int have_argument = 0;
+    int group = 0;
     char operation = '\0';
     char c;
 
     while ((c = read_next_char(s)) != '\0' && c != ',') {
-        if (c == '(' || c == ')') continue;
-        if (!have_value && c == '-') {
+        if (c == '(' && !have_value && !negative && !group) {
+            group = 1;   /* "(D)N": D vai em value e N em argument */
+        } else if (c == ')' && group && have_value && !operation) {
+            operation = '(';
+        } else if (!have_value && !group && c == '-') {
             negative = 1;
         } else if (c >= '0' && c <= '9') {
             uint64_t *destination = operation ? &argument : &value;
             *destination = *destination * 10 + (uint64_t)(c - '0');
             if (operation) have_argument = 1;
             else have_value = 1;
-        } else if ((c == '^' || c == '~') && have_value && !operation) {
+        } else if ((c == '^' || c == '~') && have_value && !operation && !group) {
             operation = c;
         } else {
             return -1;
         }
     }
 
-    if (!have_value) return 0;
+    if (!have_value) return group ? -1 : 0;
+    if (group && operation != '(') return -1;
     if (operation && !have_argument) return -1;
     if ((!negative && value > INT32_MAX_VAL) ||
         (negative && value > UINT64_C(2147483648)) ||
@@ -190,6 +351,441 @@ static int read_token_stream(Stream4Bit *s, ParsedToken *token) {
     return 1;
 }
 
+/* ============================================================================
+ * MODO BINÁRIO (TXAC_FLAG_BINARY)
+ * Cada token é um código Rice de s com k adaptativo (espelho do encoder):
+ *   s >= 2  → valor simples, zigzag(valor) = s - 2
+ *   s == 0  → run '^':    Rice(zigzag(valor)) + Exp-Golomb(repetições - 2)
+ *   s == 1  → sniper '~': Rice(zigzag(valor)) + Exp-Golomb(buraco)
+ * Nos blocos TXAC_BLOCK_GROUPS o s == 0 traz mais 1 bit: 0 = run, 1 = grupo '(':
+ *   Exp-Golomb(distância - 1) + Exp-Golomb(N - GROUP_MIN_LEN)
+ * k vem da média móvel dos zigzag do bloco; nada de dígitos decimais.
+ * ========================================================================== */
+#define RESIDUAL_K0   4    /* k inicial de cada bloco */
+#define RICE_ESCAPE_Q 24   /* quociente de escape: comprimento em 6 bits + valor cru */
+#define GROUP_MIN_LEN 3    /* menor grupo '(' do modo binário */
+
+static inline unsigned residual_k(uint64_t mean16) {
+    uint64_t avg = mean16 >> 4;
+    return avg ? 63 - (unsigned)__builtin_clzll(avg) : 0;
+}
+
+/* Consome n bits (n <= 56) do bit-buffer; -1 se o stream acabar antes */
+static inline int stream_take(Stream4Bit *s, unsigned n, uint64_t *out) {
+    if (n > s->bit_limit - s->bit_pos) { s->bit_pos = s->bit_limit; return -1; }
+    if (n == 0) { *out = 0; return 0; }
+    if (s->bit_avail < n) stream_refill(s);
+    *out = s->bit_buf >> (64 - n);
+    s->bit_buf   <<= n;
+    s->bit_avail  -= n;
+    s->bit_pos    += n;
+    return 0;
+}
+
+static inline int read_rice_adaptive(Stream4Bit *s, unsigned k, uint64_t *out) {
+    if (s->bit_avail < RICE_ESCAPE_Q + 1) stream_refill(s);
+    unsigned ones = (unsigned)__builtin_clzll(~s->bit_buf | 1);
+    unsigned q    = ones < RICE_ESCAPE_Q ? ones : RICE_ESCAPE_Q;
+    uint64_t bits;
+    /* Quociente unário (+ zero terminador, exceto no escape) */
+    if (stream_take(s, q < RICE_ESCAPE_Q ? q + 1 : q, &bits) < 0) return -1;
+
+    if (q == RICE_ESCAPE_Q) {
+        uint64_t len;
+        if (stream_take(s, 6, &len) < 0) return -1;
+        if (len == 0 || len > 40) { s->bit_pos = s->bit_limit; return -1; }
+        return stream_take(s, (unsigned)len, out);
+    }
+
+    uint64_t r;
+    if (stream_take(s, k, &r) < 0) return -1;
+    *out = ((uint64_t)q << k) | r;
+    return 0;
+}
+
+static inline int read_expgolomb(Stream4Bit *s, uint64_t *n) {
+    if (s->bit_avail < 56) stream_refill(s);
+    unsigned zeros = s->bit_buf ? (unsigned)__builtin_clzll(s->bit_buf) : 64;
+    uint64_t x;
+    if (zeros > 34) { s->bit_pos = s->bit_limit; return -1; }
+    if (stream_take(s, zeros, &x) < 0 || stream_take(s, zeros + 1, &x) < 0) return -1;
+    *n = x - 1;
+    return 0;
+}
+
+/* Mesmo contrato de read_token_stream: 1 = token, 0 = fim, -1 = inválido */
+static int read_token_binary(Stream4Bit *s, uint64_t *mean16, ParsedToken *token) {
+    if (s->bit_pos >= s->bit_limit) return 0;
+
+    unsigned k = residual_k(*mean16);
+    uint64_t sym, z, argument = 0;
+    char operation = '\0';
+
+    if (read_rice_adaptive(s, k, &sym) < 0) return -1;
+    uint64_t is_group = 0;
+    if (sym == 0 && s->groups && stream_take(s, 1, &is_group) < 0) return -1;
+    if (is_group) {
+        /* Grupo: distância e N, sem valor; a média móvel não muda */
+        uint64_t dist;
+        if (read_expgolomb(s, &dist) < 0 || read_expgolomb(s, &argument) < 0) return -1;
+        argument += GROUP_MIN_LEN;
+        if (dist >= INT32_MAX_VAL || argument > UINT32_MAX) return -1;
+        token->value     = (int32_t)(dist + 1);
+        token->argument  = (uint32_t)argument;
+        token->operation = '(';
+        return 1;
+    }
+    if (sym >= 2) {
+        z = sym - 2;
+    } else {
+        operation = sym == 0 ? '^' : '~';
+        if (read_rice_adaptive(s, k, &z) < 0 || read_expgolomb(s, &argument) < 0)
+            return -1;
+        if (operation == '^') argument += 2;
+    }
+    *mean16 += z - (*mean16 >> 4);
+
+    if (z > UINT32_MAX || argument > UINT32_MAX) return -1;
+    token->value     = (int32_t)((uint32_t)(z >> 1) ^ (0u - (uint32_t)(z & 1)));
+    token->argument  = (uint32_t)argument;
+    token->operation = operation;
+    return 1;
+}
+
+/* ============================================================================
+ * PREDITOR DO BLOCO (TXAC_FLAG_PREDICTOR)
+ * amostra[i] = resíduo[i] + (Σ coef[j] * amostra[i-1-j]) >> shift, com a soma
+ * em int32 (wrap-around) e amostras anteriores ao bloco valendo 0. Polinômios
+ * fixos de ordem 0..4 usam shift 0; o LPC traz shift e coeficientes int16 no
+ * header, e o encoder garante que a soma dele cabe em 32 bits.
+ * Sem a flag o bloco é ordem 1 (delta) ou 0, conforme o flag bit 1.
+ * ========================================================================== */
+#define FIXED_MAX_ORDER 4
+#define LPC_MAX_ORDER   32
+
+typedef struct {
+    uint8_t order;
+    uint8_t lpc;
+    uint8_t shift;
+    uint8_t lms_stages;  /* estágios LMS a desfazer antes do preditor */
+    uint8_t stereo;      /* modo estéreo do par (canal da esquerda) */
+    int32_t constant;    /* valor de todas as amostras de um TXAC_BLOCK_CONSTANT */
+    uint8_t wasted;      /* bits zero devolvidos no fim do bloco (<< depois do preditor) */
+    int32_t coef[LPC_MAX_ORDER];
+} Predictor;
+
+static const int32_t fixed_coefs[FIXED_MAX_ORDER + 1][FIXED_MAX_ORDER] = {
+    { 0 },
+    { 1 },
+    { 2, -1 },
+    { 3, -3, 1 },
+    { 4, -6, 4, -1 }
+};
+
+static void predictor_fixed(Predictor *p, unsigned order) {
+    memset(p, 0, sizeof(*p));
+    p->order = (uint8_t)order;
+    for (unsigned j = 0; j < order; j++) p->coef[j] = fixed_coefs[order][j];
+}
+
+/* Lê o preditor em payload[0..avail); devolve os bytes usados ou -1.
+ * Bit 6 do primeiro byte: um byte de bits desperdiçados (1..31) no fim. */
+static int predictor_read_header(Predictor *p, const uint8_t *payload, size_t avail) {
+    if (avail < 1) return -1;
+    unsigned order = payload[0] & 0x3F;
+    size_t used;
+    if (!(payload[0] & 0x80)) {
+        if (order > FIXED_MAX_ORDER) return -1;
+        predictor_fixed(p, order);
+        used = 1;
+    } else {
+        if (order == 0 || order > LPC_MAX_ORDER || avail < 2 + 2 * (size_t)order) return -1;
+        if (payload[1] > 31) return -1;
+        memset(p, 0, sizeof(*p));
+        p->order = (uint8_t)order;
+        p->lpc   = 1;
+        p->shift = payload[1];
+        for (unsigned j = 0; j < order; j++)
+            p->coef[j] = (int16_t)(payload[2 + 2 * j] | (payload[3 + 2 * j] << 8));
+        used = 2 + 2 * (size_t)order;
+    }
+    if (payload[0] & 0x40) {
+        if (avail < used + 1 || payload[used] == 0 || payload[used] > 31) return -1;
+        p->wasted = payload[used++];
+    }
+    return (int)used;
+}
+
+/* Ordem curta: com 'order' constante o compilador desenrola o produto escalar */
+static inline __attribute__((always_inline))
+void restore_short(int32_t *x, size_t i, size_t n, const int32_t *coef,
+                   unsigned order, unsigned shift) {
+    for (; i < n; i++) {
+        const int32_t *h = x + i - 1;
+        uint32_t sum = 0;
+        for (unsigned j = 0; j < order; j++) sum += (uint32_t)coef[j] * (uint32_t)h[-(ptrdiff_t)j];
+        x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)((int32_t)sum >> shift));
+    }
+}
+
+/* Reconstrói as amostras do bloco no próprio buffer de resíduos */
+static void restore_prediction(int32_t *x, size_t n, const Predictor *p) {
+    const unsigned order = p->order, shift = p->shift;
+    const int32_t *c = p->coef;
+    if (order == 0) return;
+
+    if (!p->lpc && order == 1) {
+        uint32_t acc = 0;
+        for (size_t i = 0; i < n; i++) x[i] = (int32_t)(acc += (uint32_t)x[i]);
+        return;
+    }
+
+    /* Aquecimento: só as amostras do próprio bloco entram na soma */
+    size_t i = 0;
+    for (; i < n && i < order; i++) {
+        uint32_t sum = 0;
+        for (unsigned j = 0; j < i; j++) sum += (uint32_t)c[j] * (uint32_t)x[i - 1 - j];
+        x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)((int32_t)sum >> shift));
+    }
+
+    switch (order) {
+    case 1: restore_short(x, i, n, c, 1, shift); return;
+    case 2: restore_short(x, i, n, c, 2, shift); return;
+    case 3: restore_short(x, i, n, c, 3, shift); return;
+    case 4: restore_short(x, i, n, c, 4, shift); return;
+    case 5: restore_short(x, i, n, c, 5, shift); return;
+    case 6: restore_short(x, i, n, c, 6, shift); return;
+    case 7: restore_short(x, i, n, c, 7, shift); return;
+    case 8: restore_short(x, i, n, c, 8, shift); return;
+    default: break;
+    }
+
+    /* Ordem > 8, de 8 em 8 amostras: os coeficientes 8.. só tocam amostras já
+     * prontas, então essa parte sai em AVX2 para as 8 de uma vez; os 8 mais
+     * recentes fecham a soma em escalar, amostra por amostra. */
+    uint32_t part[8] __attribute__((aligned(32)));
+    for (; i + 8 <= n; i += 8) {
+        __m256i acc = _mm256_setzero_si256();
+        for (unsigned j = 8; j < order; j++)
+            acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(_mm256_set1_epi32(c[j]),
+                      _mm256_loadu_si256((const __m256i *)(x + i - 1 - j))));
+        _mm256_store_si256((__m256i *)part, acc);
+        for (unsigned k = 0; k < 8; k++) {
+            const int32_t *h = x + i + k - 1;
+            uint32_t sum = part[k];
+            for (unsigned j = 0; j < 8; j++) sum += (uint32_t)c[j] * (uint32_t)h[-(ptrdiff_t)j];
+            x[i + k] = (int32_t)((uint32_t)x[i + k] + (uint32_t)((int32_t)sum >> shift));
+        }
+    }
+    for (; i < n; i++) {
+        uint32_t sum = 0;
+        for (unsigned j = 0; j < order; j++) sum += (uint32_t)c[j] * (uint32_t)x[i - 1 - j];
+        x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)((int32_t)sum >> shift));
+    }
+}
+
+/* Devolve os bits desperdiçados do bloco depois do preditor, 8 por vez */
+static void restore_wasted(int32_t *x, size_t n, unsigned wasted) {
+    if (!wasted) return;
+    __m128i count = _mm_cvtsi32_si128((int)wasted);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(x + i),
+                            _mm256_sll_epi32(_mm256_loadu_si256((const __m256i *)(x + i)), count));
+    for (; i < n; i++) x[i] = (int32_t)((uint32_t)x[i] << wasted);
+}
+
+/* ============================================================================
+ * CASCATA SIGN-SIGN LMS (TXAC_FLAG_LMS, encoder --best)
+ * Depois do preditor, o encoder pode ter passado os resíduos do bloco por
+ * filtros adaptativos em série; o byte de estágios no header diz quantos.
+ * Cada estágio prevê a sua entrada pelas últimas 'order' entradas saturadas em
+ * int16 (pmaddwd) e ajusta os pesos int16 só pelos sinais:
+ *   w[j] += sign(erro) * sign(entrada[i-1-j]) * LMS_STEP
+ * O estado zera em cada bloco. Aqui os estágios são desfeitos do último para
+ * o primeiro, com as mesmas contas inteiras do encoder (bit a bit).
+ * ========================================================================== */
+#define LMS_STAGES    2
+#define LMS_MAX_ORDER 64
+#define LMS_STEP      2
+
+static const struct { unsigned order, shift; } lms_cascade[LMS_STAGES] = {
+    { 64, 11 },
+    { 16, 10 }
+};
+
+static inline int16_t lms_sat16(int32_t v) {
+    return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+static inline int32_t lms_dot(const int16_t *w, const int16_t *h, unsigned order) {
+    __m256i acc = _mm256_setzero_si256();
+    for (unsigned j = 0; j < order; j += 16)
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+                  _mm256_load_si256((const __m256i *)(w + j)),
+                  _mm256_loadu_si256((const __m256i *)(h + j))));
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+
+static inline void lms_adapt(int16_t *w, const int16_t *sgn, unsigned order, int32_t err) {
+    for (unsigned j = 0; j < order; j += 16) {
+        __m256i wv = _mm256_load_si256((const __m256i *)(w + j));
+        __m256i sv = _mm256_loadu_si256((const __m256i *)(sgn + j));
+        wv = err > 0 ? _mm256_add_epi16(wv, sv) : _mm256_sub_epi16(wv, sv);
+        _mm256_store_si256((__m256i *)(w + j), wv);
+    }
+}
+
+/* Desfaz um estágio no lugar: x (erro) volta a ser a entrada do estágio.
+ * hist/sgn precisam de n + order posições. */
+static void lms_undo_stage(int32_t *x, size_t n, unsigned order, unsigned shift,
+                           int16_t *hist, int16_t *sgn) {
+    int16_t w[LMS_MAX_ORDER] __attribute__((aligned(32)));
+    memset(w, 0, sizeof(w));
+    memset(hist, 0, order * sizeof(int16_t));
+    memset(sgn, 0, order * sizeof(int16_t));
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t pred = (uint32_t)(lms_dot(w, hist + i, order) >> shift);
+        int32_t  err  = x[i];
+        int32_t  in   = (int32_t)((uint32_t)err + pred);
+        x[i] = in;
+        if (err != 0) lms_adapt(w, sgn + i, order, err);
+        hist[i + order] = lms_sat16(in);
+        sgn[i + order]  = (int16_t)(in > 0 ? LMS_STEP : in < 0 ? -LMS_STEP : 0);
+    }
+}
+
+/* Desfaz 'stages' estágios da cascata; devolve -1 sem memória */
+static int lms_restore(int32_t *x, size_t n, unsigned stages) {
+    if (stages == 0 || n == 0) return 0;
+    int16_t *hist = (int16_t *)malloc((n + LMS_MAX_ORDER) * sizeof(int16_t));
+    int16_t *sgn  = (int16_t *)malloc((n + LMS_MAX_ORDER) * sizeof(int16_t));
+    if (!hist || !sgn) {
+        free(hist);
+        free(sgn);
+        return -1;
+    }
+    for (unsigned st = stages; st-- > 0;)
+        lms_undo_stage(x, n, lms_cascade[st].order, lms_cascade[st].shift, hist, sgn);
+    free(hist);
+    free(sgn);
+    return 0;
+}
+
+/* ============================================================================
+ * ACOPLAMENTO ESTÉREO (TXAC_FLAG_STEREO)
+ * Pares de canais vizinhos (máscara no header, bit i = canais i e i+1) trazem
+ * o modo do bloco no header do bloco do canal da esquerda:
+ *   0 = L/R   1 = L/S   2 = S/R   3 = M/S,  com S = L - R e M = (L + R) >> 1
+ * Desfeito em AVX2 depois do preditor, antes do ganho e da intercalação.
+ * ========================================================================== */
+#define STEREO_INDEPENDENT 0
+#define STEREO_LEFT_SIDE   1
+#define STEREO_SIDE_RIGHT  2
+#define STEREO_MID_SIDE    3
+
+/* a/b entram com os sinais do modo e saem como L/R, 8 amostras por vez */
+static void stereo_undo(int32_t *a, int32_t *b, size_t n, unsigned mode) {
+    const __m256i one = _mm256_set1_epi32(1);
+    size_t i = 0;
+    switch (mode) {
+    case STEREO_LEFT_SIDE:   /* R = L - S */
+        for (; i + 8 <= n; i += 8) {
+            __m256i l = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i s = _mm256_loadu_si256((const __m256i *)(b + i));
+            _mm256_storeu_si256((__m256i *)(b + i), _mm256_sub_epi32(l, s));
+        }
+        for (; i < n; i++) b[i] = (int32_t)((uint32_t)a[i] - (uint32_t)b[i]);
+        break;
+    case STEREO_SIDE_RIGHT:  /* L = S + R */
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i r = _mm256_loadu_si256((const __m256i *)(b + i));
+            _mm256_storeu_si256((__m256i *)(a + i), _mm256_add_epi32(s, r));
+        }
+        for (; i < n; i++) a[i] = (int32_t)((uint32_t)a[i] + (uint32_t)b[i]);
+        break;
+    case STEREO_MID_SIDE:    /* L = M + (S >> 1) + (S & 1), R = L - S */
+        for (; i + 8 <= n; i += 8) {
+            __m256i m = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i s = _mm256_loadu_si256((const __m256i *)(b + i));
+            __m256i l = _mm256_add_epi32(_mm256_add_epi32(m, _mm256_srai_epi32(s, 1)),
+                                         _mm256_and_si256(s, one));
+            _mm256_storeu_si256((__m256i *)(a + i), l);
+            _mm256_storeu_si256((__m256i *)(b + i), _mm256_sub_epi32(l, s));
+        }
+        for (; i < n; i++) {
+            int32_t s = b[i];
+            int32_t l = (int32_t)((uint32_t)a[i] + (uint32_t)(s >> 1) + (uint32_t)(s & 1));
+            a[i] = l;
+            b[i] = (int32_t)((uint32_t)l - (uint32_t)s);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* Abre o stream de tokens de um bloco v5 e lê o header do bloco: tipo
+ * (TXAC_BLOCK_GROUPS só com TXAC_FLAG_GROUPS), k
+ * (TXAC_FLAG_BLOCK_PARAMS), preditor (TXAC_FLAG_PREDICTOR), estágios LMS
+ * (TXAC_FLAG_LMS) e modo estéreo (TXAC_FLAG_STEREO, só na esquerda de um par).
+ * Campos ausentes assumem os valores fixos do formato. Um TXAC_BLOCK_CONSTANT
+ * traz só o valor (int32 LE) e o modo estéreo, e não abre stream nenhum.
+ * Devolve o tipo do bloco, ou -1 se o header for inválido. */
+static int init_block_stream(Stream4Bit *s, Predictor *pred, uint8_t *payload,
+                             uint32_t bit_size, uint32_t flags) {
+    const int binary = (flags & TXAC_FLAG_BINARY) != 0;
+    size_t avail = bit_size / 8, header = 1;
+    unsigned k = binary ? RESIDUAL_K0 : 1;
+    if (avail < 1) return -1;
+
+    if (payload[0] == TXAC_BLOCK_CONSTANT && (flags & TXAC_FLAG_CONSTANT)) {
+        if (avail < 5) return -1;
+        predictor_fixed(pred, 0);
+        pred->constant = (int32_t)((uint32_t)payload[1] | ((uint32_t)payload[2] << 8) |
+                                   ((uint32_t)payload[3] << 16) | ((uint32_t)payload[4] << 24));
+        if (flags & TXAC_FLAG_STEREO) {
+            if (avail < 6 || payload[5] > STEREO_MID_SIDE) return -1;
+            pred->stereo = payload[5];
+        }
+        return TXAC_BLOCK_CONSTANT;
+    }
+    const int groups = payload[0] == TXAC_BLOCK_GROUPS && (flags & TXAC_FLAG_GROUPS);
+    if (payload[0] != TXAC_BLOCK_TOKENS && !groups) return -1;
+
+    if (flags & TXAC_FLAG_BLOCK_PARAMS) {
+        if (avail < 2) return -1;
+        k = payload[header++];
+        if (k > (binary ? 32u : RICE_MAX_K)) return -1;
+    }
+    if (flags & TXAC_FLAG_PREDICTOR) {
+        int used = predictor_read_header(pred, payload + header, avail - header);
+        if (used < 0 || (pred->wasted && !(flags & TXAC_FLAG_WASTED))) return -1;
+        header += (size_t)used;
+    } else {
+        predictor_fixed(pred, (flags & (1 << 1)) ? 1 : 0);
+    }
+    if (flags & TXAC_FLAG_LMS) {
+        if (avail < header + 1 || payload[header] > LMS_STAGES) return -1;
+        pred->lms_stages = payload[header++];
+    }
+    if (flags & TXAC_FLAG_STEREO) {
+        if (avail < header + 1 || payload[header] > STEREO_MID_SIDE) return -1;
+        pred->stereo = payload[header++];
+    }
+
+    init_stream_bits(s, payload + header, bit_size - header * 8);
+    s->rice_k = k;
+    s->table  = rice_table[binary ? 1 : k];
+    s->groups = groups;
+    return payload[0];
+}
+
 /* ============================================================================
  * APLICAÇÃO DE GANHO COM CLIPPING  →  int32
  * ========================================================================== */
@@ -200,6 +796,79 @@ static inline int32_t apply_gain_and_clip(double value) {
     return (int32_t)boosted;
 }
 
+/* Modo cru (blocos v5): o valor sai como resíduo, o ganho vem depois */
+static inline int32_t output_sample(int raw, int32_t value) {
+    return raw ? value : apply_gain_and_clip((double)value);
+}
+
+/* Ganho + clipping do bloco inteiro, 4 amostras por vez em double (AVX2);
+ * mesmo resultado de apply_gain_and_clip amostra a amostra */
+static void apply_gain_block(int32_t *x, size_t n) {
+    const __m256d gain = _mm256_set1_pd(AMPLITUDE_FACTOR);
+    const __m256d hi   = _mm256_set1_pd((double)INT32_MAX_VAL);
+    const __m256d lo   = _mm256_set1_pd((double)INT32_MIN_VAL);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(x + i)));
+        v = _mm256_max_pd(_mm256_min_pd(_mm256_mul_pd(v, gain), hi), lo);
+        _mm_storeu_si128((__m128i *)(x + i), _mm256_cvttpd_epi32(v));
+    }
+    for (; i < n; i++) x[i] = apply_gain_and_clip((double)x[i]);
+}
+
+/* ============================================================================
+ * ARQUIVO MAPEADO
+ * Os streams Rice leem direto das páginas do .txac, sem cópia na RAM. Pipes,
+ * dispositivos e arquivos vazios não mapeiam: main volta para o fread.
+ * ========================================================================== */
+typedef struct {
+    uint8_t *data;   /* arquivo inteiro, só leitura */
+    uint64_t size;
+#if defined(_WIN32)
+    HANDLE   mapping;
+#endif
+} MappedFile;
+
+static int map_file(FILE *f, MappedFile *m) {
+    memset(m, 0, sizeof(*m));
+#if defined(_WIN32)
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+    LARGE_INTEGER size;
+    if (h == INVALID_HANDLE_VALUE || GetFileType(h) != FILE_TYPE_DISK ||
+        !GetFileSizeEx(h, &size) || size.QuadPart <= 0) return 0;
+    m->mapping = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m->mapping) return 0;
+    m->data = (uint8_t *)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m->data) {
+        CloseHandle(m->mapping);
+        m->mapping = NULL;
+        return 0;
+    }
+    m->size = (uint64_t)size.QuadPart;
+#else
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return 0;
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (p == MAP_FAILED) return 0;
+    /* Cada segmento anda para frente no arquivo: readahead agressivo */
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+    m->data = (uint8_t *)p;
+    m->size = (uint64_t)st.st_size;
+#endif
+    return 1;
+}
+
+static void unmap_file(MappedFile *m) {
+    if (!m->data) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(m->data);
+    CloseHandle(m->mapping);
+#else
+    munmap(m->data, (size_t)m->size);
+#endif
+    memset(m, 0, sizeof(*m));
+}
+
 /* ============================================================================
  * DECODER POR CANAL
  * ========================================================================== */
@@ -208,122 +877,251 @@ typedef struct {
     uint8_t     *compressed_4bit;
     size_t       compressed_size;
     BufferInt32 *output_buffer;
-    pthread_t    thread;
     volatile int finished;
     int          use_delta_encoding;   /* novo: detectado via flag bit 1 */
+    int          binary;               /* TXAC_FLAG_BINARY */
+    uint32_t     flags;                /* flags do header; TXAC_FLAG_STEREO só na esquerda de um par */
+    /* v5: blocos do canal dentro da região de dados (compressed_4bit começa
+     * em data_base no arquivo); entradas separadas por block_stride. */
+    const TXACBlockEntry *blocks;
+    uint32_t     block_count;
+    uint32_t     block_stride;
+    uint64_t     data_base;
 } ChannelDecoder;
 
-/* Recursão de parsing — espelha process_stream_to_14bit() do txacplay v14,
- * mas produz int32 com ganho para escrita direta no WAV. */
-static void process_stream_to_int32(ChannelDecoder *dec, Stream4Bit *stream,
-                                    uint64_t *sample_idx, int recursion_depth,
-                                    int32_t *accumulator) {
-    if (recursion_depth > 100) return;
-
-    while (stream->bit_pos < stream->byte_count * 8) {
-        ParsedToken token;
-        int token_status = read_token_stream(stream, &token);
-        if (token_status <= 0) break;
+/* Grupo (D)N: dst[i] = dst[i - dist] em ordem crescente, então dist < len
+ * repete o trecho, como no LZ77. Sem sobreposição é um memcpy; com dist >= 8
+ * cada carga de 8 já está escrita e a cópia vai em AVX2. */
+static inline void copy_group(int32_t *dst, uint32_t dist, uint32_t len) {
+    const int32_t *src = dst - dist;
+    if (dist >= len) {
+        memcpy(dst, src, (size_t)len * sizeof(int32_t));
+        return;
+    }
+    uint32_t i = 0;
+    if (dist >= 8)
+        for (; i + 8 <= len; i += 8)
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+    for (; i < len; i++) dst[i] = src[i];
+}
 
-        uint32_t rep;
-        int32_t delta;
-        int32_t out;
+/* Bloco TXAC_BLOCK_CONSTANT: silêncio vai de memset, DC em stores AVX2 */
+static void fill_constant(int32_t *dst, size_t n, int32_t value) {
+    if (value == 0) {
+        memset(dst, 0, n * sizeof(int32_t));
+        return;
+    }
+    const __m256i v = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_si256((__m256i *)(dst + i), v);
+    for (; i < n; i++) dst[i] = value;
+}
 
+/* Âncora de sniper pendente: 'delta' volta a ser aplicado depois que
+ * 'remaining' tokens do buraco forem decodificados. */
+typedef struct {
+    int32_t  delta;
+    uint32_t remaining;
+} SniperAnchor;
+
+/* Máquina de estados plana no lugar da antiga recursão (um nível por
+ * elemento do buraco '~', limitada a 100). As âncoras pendentes ficam numa
+ * pilha explícita sem limite e o acumulador fica em variável local. */
+static void process_stream_to_int32(ChannelDecoder *dec, BufferInt32 *buf,
+                                    Stream4Bit *stream, uint64_t *sample_idx,
+                                    int32_t *accumulator, int raw) {
+    const int use_delta = !raw && dec->use_delta_encoding;
+    int32_t  acc = *accumulator;
+    uint64_t produced = 0;
+    uint64_t mean16 = (uint64_t)16 << stream->rice_k;   /* estado do modo binário */
+
+    SniperAnchor  inline_stack[64];
+    SniperAnchor *stack = inline_stack;
+    size_t depth = 0, stack_cap = 64;
+
+    for (;;) {
+        ParsedToken token;
+        int token_status = !stream_has_data(stream) ? 0
+                         : dec->binary ? read_token_binary(stream, &mean16, &token)
+                         : read_token_stream(stream, &token);
+
+        if (token_status <= 0) {
+            if (depth == 0) break;
+            /* Fim do stream: as âncoras pendentes ainda são emitidas */
+            if (!stream_has_data(stream)) {
+                while (depth > 0) {
+                    int32_t d = stack[--depth].delta;
+                    if (use_delta) acc += d; else acc = d;
+                    push_value_int32(buf, output_sample(raw, acc));
+                    produced++;
+                }
+                break;
+            }
+            /* Token vazio/inválido dentro do buraco conta como elemento */
+        }
         /* --- Caso 1: Repetição  valor^N ---------------------------------- */
-        if (token.operation == '^') {
-            delta = token.value;
-            rep = token.argument;
-            ensure_buffer_capacity(dec->output_buffer, (uint64_t)rep);
-
-            if (!dec->use_delta_encoding || delta == 0) {
+        else if (token.operation == '^') {
+            int32_t  delta = token.value;
+            uint32_t rep   = token.argument;
+            ensure_buffer_capacity(buf, (uint64_t)rep);
+            if (buf->fixed && rep > buf->capacity - buf->count)
+                rep = (uint32_t)(buf->capacity - buf->count);
+            int32_t *dst = buf->data + buf->count;
+
+            if (!use_delta || delta == 0) {
                 /* Todos os N samples têm o mesmo valor → AVX2 */
-                if (!dec->use_delta_encoding)
-                    *accumulator = delta;
+                if (!use_delta) acc = delta;
                 /* (delta==0 com delta_encoding: acumulador não muda) */
+                int32_t out = output_sample(raw, acc);
 
-                out = apply_gain_and_clip((double)*accumulator);
-
-                if (rep >= 8) {
-                    __m256i vv = _mm256_set1_epi32(out);
-                    uint32_t blocks = rep / 8;
-                    for (uint32_t i = 0; i < blocks; i++) {
-                        _mm256_storeu_si256(
-                            (__m256i *)&dec->output_buffer->data[dec->output_buffer->count],
-                            vv);
-                        dec->output_buffer->count += 8;
-                        *sample_idx += 8;
-                    }
-                    uint32_t rem = rep % 8;
-                    for (uint32_t i = 0; i < rem; i++) {
-                        dec->output_buffer->data[dec->output_buffer->count++] = out;
-                        (*sample_idx)++;
-                    }
-                } else {
-                    for (uint32_t i = 0; i < rep; i++) {
-                        dec->output_buffer->data[dec->output_buffer->count++] = out;
-                        (*sample_idx)++;
-                    }
-                }
+                uint32_t i = 0;
+                __m256i vv = _mm256_set1_epi32(out);
+                for (; i + 8 <= rep; i += 8)
+                    _mm256_storeu_si256((__m256i *)(dst + i), vv);
+                for (; i < rep; i++) dst[i] = out;
             } else {
                 /* Delta != 0: cada sample acumula valor diferente */
                 for (uint32_t i = 0; i < rep; i++) {
-                    *accumulator += delta;
-                    out = apply_gain_and_clip((double)*accumulator);
-                    dec->output_buffer->data[dec->output_buffer->count++] = out;
-                    (*sample_idx)++;
+                    acc += delta;
+                    dst[i] = output_sample(raw, acc);
                 }
             }
-
-            if (recursion_depth > 0) return;
+            buf->count += rep;
+            produced   += rep;
         }
-        /* --- Caso 2: Sniper  valor~N ------------------------------------- */
-        else if (token.operation == '~') {
-            delta = token.value;
-            rep = token.argument;
-
-            if (dec->use_delta_encoding) *accumulator += delta;
-            else                          *accumulator  = delta;
-
-            out = apply_gain_and_clip((double)*accumulator);
-            push_value_int32(dec->output_buffer, out);
-            (*sample_idx)++;
-
-            for (uint32_t i = 0; i < rep; i++) {
-                process_stream_to_int32(dec, stream, sample_idx,
-                                        recursion_depth + 1, accumulator);
+        /* --- Caso 4: Grupo (D)N, só em blocos v5 (resíduos crus) -------- */
+        else if (token.operation == '(') {
+            uint32_t dist = (uint32_t)token.value;
+            uint32_t len  = token.argument;
+            if (raw && dist >= 1 && dist <= buf->count) {
+                if (len > buf->capacity - buf->count)
+                    len = (uint32_t)(buf->capacity - buf->count);
+                copy_group(buf->data + buf->count, dist, len);
+                buf->count += len;
+                produced   += len;
+                if (len) acc = buf->data[buf->count - 1];
             }
+        }
+        /* --- Casos 2 e 3: Sniper valor~N e valor simples ----------------- */
+        else {
+            int32_t delta = token.value;
+            if (use_delta) acc += delta; else acc = delta;
+            push_value_int32(buf, output_sample(raw, acc));
+            produced++;
+
+            if (token.operation == '~') {
+                if (token.argument > 0) {
+                    /* O token só termina depois do buraco e da âncora */
+                    if (depth == stack_cap) {
+                        size_t new_cap = stack_cap * 2;
+                        SniperAnchor *grown = (SniperAnchor *)malloc(new_cap * sizeof(SniperAnchor));
+                        if (!grown) {
+                            fprintf(stderr, "Error: Insufficient memory\n");
+                            exit(1);
+                        }
+                        memcpy(grown, stack, depth * sizeof(SniperAnchor));
+                        if (stack != inline_stack) free(stack);
+                        stack = grown;
+                        stack_cap = new_cap;
+                    }
+                    stack[depth].delta     = delta;
+                    stack[depth].remaining = token.argument;
+                    depth++;
+                    continue;
+                }
+                /* Buraco vazio: a âncora vem logo em seguida */
+                if (use_delta) acc += delta; else acc = delta;
+                push_value_int32(buf, output_sample(raw, acc));
+                produced++;
+            }
+        }
 
-            /* Repete o valor âncora ao final (comportamento do txacplay) */
-            if (dec->use_delta_encoding) *accumulator += delta;
-            else                          *accumulator  = delta;
+        /* Token completo: conta como um elemento do buraco do topo da pilha;
+         * fechar um sniper completa, por sua vez, um elemento do anterior. */
+        while (depth > 0 && --stack[depth - 1].remaining == 0) {
+            int32_t d = stack[--depth].delta;
+            if (use_delta) acc += d; else acc = d;
+            push_value_int32(buf, output_sample(raw, acc));
+            produced++;
+        }
+    }
 
-            out = apply_gain_and_clip((double)*accumulator);
-            push_value_int32(dec->output_buffer, out);
-            (*sample_idx)++;
+    if (stack != inline_stack) free(stack);
+    *accumulator = acc;
+    *sample_idx += produced;
+}
 
-            if (recursion_depth > 0) return;
+/* Decodifica o bloco b do canal direto na sua posição final no buffer do
+ * canal, ainda sem o ganho. Blocos são independentes, então vários rodam ao
+ * mesmo tempo. Devolve o modo estéreo do bloco (0 fora de pares). */
+static unsigned decode_block_raw(ChannelDecoder *dec, uint32_t b) {
+    const TXACBlockEntry *e = &dec->blocks[(size_t)b * dec->block_stride];
+    BufferInt32 slot;
+    slot.data     = dec->output_buffer->data + e->sample_index;
+    slot.capacity = e->sample_count;
+    slot.count    = 0;
+    slot.fixed    = 1;
+    unsigned stereo = STEREO_INDEPENDENT;
+
+    if (e->bit_size >= 8) {
+        uint8_t *payload = dec->compressed_4bit + (e->byte_offset - dec->data_base);
+        Stream4Bit stream;
+        Predictor  pred;
+        int type = init_block_stream(&stream, &pred, payload, e->bit_size, dec->flags);
+        if (type < 0) {
+            fprintf(stderr, "  [Channel %d] Invalid header (type %u) in block %u\n",
+                    dec->channel_id, payload[0], b);
+        } else if (type == TXAC_BLOCK_CONSTANT) {
+            /* Sem tokens, LMS nem preditor: o bloco já é a amostra final */
+            fill_constant(slot.data, slot.capacity, pred.constant);
+            slot.count = slot.capacity;
+            stereo = pred.stereo;
+        } else {
+            /* Resíduos primeiro, no próprio slot; depois LMS e preditor */
+            uint64_t block_idx = 0;
+            int32_t  accumulator = 0;
+            process_stream_to_int32(dec, &slot, &stream, &block_idx, &accumulator, 1);
+            if (lms_restore(slot.data, slot.count, pred.lms_stages) < 0)
+                fprintf(stderr, "  [Channel %d] Out of memory for LMS in block %u\n",
+                        dec->channel_id, b);
+            restore_prediction(slot.data, slot.count, &pred);
+            restore_wasted(slot.data, slot.count, pred.wasted);
+            stereo = pred.stereo;
         }
-        /* --- Caso 3: Valor simples --------------------------------------- */
-        else if (token.operation == '\0') {
-            delta = token.value;
+    }
 
-            if (dec->use_delta_encoding) {
-                /* Primeiro sample inicializa; demais acumulam */
-                if (*sample_idx == 0) *accumulator  = delta;
-                else                  *accumulator += delta;
-            } else {
-                *accumulator = delta;
-            }
+    /* Bloco curto (dados corrompidos) vira silêncio até o tamanho declarado */
+    if (slot.count < slot.capacity)
+        memset(slot.data + slot.count, 0, (slot.capacity - slot.count) * sizeof(int32_t));
+    return stereo;
+}
 
-            out = apply_gain_and_clip((double)*accumulator);
-            push_value_int32(dec->output_buffer, out);
-            (*sample_idx)++;
-            if (recursion_depth > 0) return;
-        }
+static void decode_block_int32(ChannelDecoder *dec, uint32_t b) {
+    const TXACBlockEntry *e = &dec->blocks[(size_t)b * dec->block_stride];
+    decode_block_raw(dec, b);
+    if (!(dec->flags & TXAC_FLAG_NATIVE))
+        apply_gain_block(dec->output_buffer->data + e->sample_index, e->sample_count);
+}
+
+/* Bloco b de um par acoplado: os dois canais, depois o modo estéreo e o ganho */
+static void decode_pair_block_int32(ChannelDecoder *l, ChannelDecoder *r, uint32_t b) {
+    const TXACBlockEntry *el = &l->blocks[(size_t)b * l->block_stride];
+    const TXACBlockEntry *er = &r->blocks[(size_t)b * r->block_stride];
+    int32_t *xl = l->output_buffer->data + el->sample_index;
+    int32_t *xr = r->output_buffer->data + er->sample_index;
+    unsigned mode = decode_block_raw(l, b);
+    decode_block_raw(r, b);
+
+    stereo_undo(xl, xr, el->sample_count < er->sample_count
+                        ? el->sample_count : er->sample_count, mode);
+    if (!(l->flags & TXAC_FLAG_NATIVE)) {
+        apply_gain_block(xl, el->sample_count);
+        apply_gain_block(xr, er->sample_count);
     }
 }
 
-static void *decoder_thread_func(void *arg) {
+/* Canal v4: um único stream, decodificado do bit 0 até o fim */
+static void decoder_channel_task(void *arg) {
     ChannelDecoder *dec = (ChannelDecoder *)arg;
     uint64_t sample_idx  = 0;
     int32_t  accumulator = 0;
@@ -336,19 +1134,244 @@ static void *decoder_thread_func(void *arg) {
 
     Stream4Bit stream;
     init_stream(&stream, dec->compressed_4bit, dec->compressed_size);
-    process_stream_to_int32(dec, &stream, &sample_idx, 0, &accumulator);
+    process_stream_to_int32(dec, dec->output_buffer, &stream, &sample_idx, &accumulator, 0);
 
     printf("  [Channel %d] %llu samples decoded\n",
            dec->channel_id, (unsigned long long)sample_idx);
     dec->finished = 1;
+}
+
+/* Segmento v5: blocos consecutivos de um canal (ou de um par acoplado),
+ * unidade de trabalho do pool */
+typedef struct {
+    ChannelDecoder *dec;
+    ChannelDecoder *pair;           /* canal da direita do par, ou NULL */
+    uint32_t        first_block;
+    uint32_t        block_count;
+} DecodeSegment;
+
+static void decode_segment_task(void *arg) {
+    DecodeSegment *seg = (DecodeSegment *)arg;
+    for (uint32_t b = 0; b < seg->block_count; b++) {
+        if (seg->pair)
+            decode_pair_block_int32(seg->dec, seg->pair, seg->first_block + b);
+        else
+            decode_block_int32(seg->dec, seg->first_block + b);
+    }
+}
+
+/* ============================================================================
+ * POOL DE THREADS COM ROUBO DE TAREFAS (mesmo esquema do encoder)
+ * Cada worker tem a própria fila: o dono tira do fim (LIFO) e quem fica sem
+ * trabalho rouba do início da fila dos outros (FIFO).
+ * ========================================================================== */
+typedef void (*TaskFunc)(void *arg);
+
+typedef struct {
+    TaskFunc fn;
+    void    *arg;
+} PoolTask;
+
+typedef struct {
+    pthread_mutex_t lock;
+    PoolTask *items;
+    size_t    head;       /* próximo a ser roubado */
+    size_t    tail;       /* próximo slot livre (o dono tira de tail - 1) */
+    size_t    capacity;
+} WorkDeque;
+
+typedef struct WorkerArg WorkerArg;
+
+typedef struct {
+    int              num_workers;
+    pthread_t       *threads;
+    WorkDeque       *deques;
+    WorkerArg       *args;
+    pthread_mutex_t  lock;
+    pthread_cond_t   work_cv;
+    pthread_cond_t   done_cv;
+    size_t           queued;      /* tarefas nas filas (lido sem lock pelos workers) */
+    size_t           pending;     /* tarefas ainda não concluídas */
+    size_t           next_deque;  /* distribuição round-robin no submit */
+    int              shutdown;
+} ThreadPool;
+
+struct WorkerArg {
+    ThreadPool *pool;
+    int         id;
+};
+
+static int deque_pop(WorkDeque *d, PoolTask *out) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) { *out = d->items[--d->tail]; ok = 1; }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static int deque_steal(WorkDeque *d, PoolTask *out) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) { *out = d->items[d->head++]; ok = 1; }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static void deque_push(WorkDeque *d, PoolTask task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->head == d->tail) d->head = d->tail = 0;
+    if (d->tail == d->capacity) {
+        /* Compacta antes de crescer: o início pode ter sido roubado */
+        size_t live = d->tail - d->head;
+        memmove(d->items, d->items + d->head, live * sizeof(PoolTask));
+        d->head = 0;
+        d->tail = live;
+        if (d->tail == d->capacity) {
+            size_t new_cap = d->capacity * 2;
+            PoolTask *grown = (PoolTask *)realloc(d->items, new_cap * sizeof(PoolTask));
+            if (!grown) { fprintf(stderr, "Error: Insufficient memory\n"); exit(1); }
+            d->items    = grown;
+            d->capacity = new_cap;
+        }
+    }
+    d->items[d->tail++] = task;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static int pool_take(ThreadPool *pool, int id, PoolTask *task) {
+    if (deque_pop(&pool->deques[id], task)) return 1;
+    for (int k = 1; k < pool->num_workers; k++)
+        if (deque_steal(&pool->deques[(id + k) % pool->num_workers], task)) return 1;
+    return 0;
+}
+
+static void *pool_worker(void *arg) {
+    WorkerArg  *wa   = (WorkerArg *)arg;
+    ThreadPool *pool = wa->pool;
+    PoolTask    task;
+
+    for (;;) {
+        if (pool_take(pool, wa->id, &task)) {
+            __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_ACQ_REL);
+            task.fn(task.arg);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0) pthread_cond_broadcast(&pool->done_cv);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        /* Nada para fazer nem para roubar: dorme até o próximo submit */
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutdown &&
+               __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0)
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+        int stop = pool->shutdown &&
+                   __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) break;
+    }
     return NULL;
 }
 
+static int detect_cpu_count(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+static void pool_init(ThreadPool *pool, int num_workers) {
+    memset(pool, 0, sizeof(*pool));
+    pool->num_workers = num_workers;
+    pool->threads = (pthread_t *)malloc(num_workers * sizeof(pthread_t));
+    pool->deques  = (WorkDeque *)calloc(num_workers, sizeof(WorkDeque));
+    pool->args    = (WorkerArg *)malloc(num_workers * sizeof(WorkerArg));
+    if (!pool->threads || !pool->deques || !pool->args) {
+        fprintf(stderr, "Error: Cannot allocate thread pool\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+
+    for (int i = 0; i < num_workers; i++) {
+        WorkDeque *d = &pool->deques[i];
+        pthread_mutex_init(&d->lock, NULL);
+        d->capacity = 64;
+        d->items = (PoolTask *)malloc(d->capacity * sizeof(PoolTask));
+        if (!d->items) { fprintf(stderr, "Error: Insufficient memory\n"); exit(1); }
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pool->args[i].pool = pool;
+        pool->args[i].id   = i;
+        pthread_create(&pool->threads[i], NULL, pool_worker, &pool->args[i]);
+    }
+}
+
+static void pool_submit(ThreadPool *pool, TaskFunc fn, void *arg) {
+    PoolTask task = { fn, arg };
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    /* Conta antes de publicar: um worker pode pegar a tarefa logo após o push */
+    __atomic_fetch_add(&pool->queued, 1, __ATOMIC_ACQ_REL);
+    deque_push(&pool->deques[pool->next_deque], task);
+    pool->next_deque = (pool->next_deque + 1) % pool->num_workers;
+    pthread_cond_signal(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Espera todas as tarefas enviadas até aqui terminarem */
+static void pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) pthread_cond_wait(&pool->done_cv, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_destroy(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->threads[i], NULL);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].items);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_cond_destroy(&pool->done_cv);
+    free(pool->threads);
+    free(pool->deques);
+    free(pool->args);
+}
+
 /* ============================================================================
  * INTERCALAÇÃO DE CANAIS
  * ========================================================================== */
+typedef struct {
+    const BufferInt32 *channels;
+    int                num_channels;
+    int32_t           *dst;
+    uint64_t           first_frame;
+    uint64_t           frame_count;
+} InterleaveTask;
+
+static void interleave_task(void *arg) {
+    InterleaveTask *t = (InterleaveTask *)arg;
+    int n = t->num_channels;
+    for (uint64_t f = t->first_frame; f < t->first_frame + t->frame_count; f++)
+        for (int c = 0; c < n; c++)
+            t->dst[f * n + c] = t->channels[c].data[f];
+}
+
 static int32_t *intercalar_canais(BufferInt32 *channels, int num_channels,
-                                   uint64_t *total_samples_out) {
+                                   uint64_t *total_samples_out, ThreadPool *pool) {
     printf("\nInterleaving channels...\n");
 
     uint64_t frames = channels[0].count;
@@ -359,9 +1382,23 @@ static int32_t *intercalar_canais(BufferInt32 *channels, int num_channels,
     int32_t *buf = (int32_t *)malloc(total * sizeof(int32_t));
     if (!buf) { fprintf(stderr, "Fatal: No RAM for interleaved buffer\n"); exit(1); }
 
-    for (uint64_t f = 0; f < frames; f++)
-        for (int c = 0; c < num_channels; c++)
-            buf[f * num_channels + c] = channels[c].data[f];
+    /* Faixas de quadros independentes, uma por tarefa */
+    int ntasks = pool->num_workers * 4;
+    InterleaveTask *tasks = (InterleaveTask *)calloc(ntasks, sizeof(InterleaveTask));
+    if (!tasks) { fprintf(stderr, "Fatal: No RAM for interleave tasks\n"); exit(1); }
+    uint64_t per_task = (frames + ntasks - 1) / ntasks;
+    for (int t = 0; t < ntasks; t++) {
+        uint64_t first = (uint64_t)t * per_task;
+        if (first >= frames) break;
+        tasks[t].channels     = channels;
+        tasks[t].num_channels = num_channels;
+        tasks[t].dst          = buf;
+        tasks[t].first_frame  = first;
+        tasks[t].frame_count  = frames - first < per_task ? frames - first : per_task;
+        pool_submit(pool, interleave_task, &tasks[t]);
+    }
+    pool_wait(pool);
+    free(tasks);
 
     *total_samples_out = total;
     printf("Interleaved: %.2f MB (%llu samples)\n",
@@ -371,23 +1408,61 @@ static int32_t *intercalar_canais(BufferInt32 *channels, int num_channels,
 }
 
 /* ============================================================================
- * SALVAR WAV 32-BIT PCM
+ * SALVAR WAV PCM (32 BITS, OU 16 EM ARQUIVOS TXAC_FLAG_NATIVE DE 16 BITS)
  * ========================================================================== */
-static void salvar_wav_32bit(const char *filename, int32_t *samples,
-                              uint64_t sample_count, uint32_t sample_rate,
-                              uint16_t channels) {
+
+/* int32 → int16 no lugar, 16 por vez; no modo nativo os valores já cabem */
+static void narrow_to_int16(int32_t *samples, uint64_t n) {
+    int16_t *dst = (int16_t *)samples;
+    uint64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(samples + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(samples + i + 8));
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i *)(dst + i), p);
+    }
+    for (; i < n; i++) dst[i] = (int16_t)samples[i];
+}
+
+/* 24 bits packed, no próprio buffer: 8 amostras viram 24 bytes (pshufb
+ * descarta o byte alto de cada int32, a permutação junta as duas metades).
+ * O store de 32 bytes só sobrescreve o que já foi lido; os 8 bytes extras
+ * são cobertos pelo próximo store ou ficam além do fim. */
+static void narrow_to_int24(int32_t *samples, uint64_t n) {
+    uint8_t *dst = (uint8_t *)samples;
+    const __m256i junta   = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i metades = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(samples + i));
+        v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, junta), metades);
+        _mm256_storeu_si256((__m256i *)(dst + 3 * i), v);
+    }
+    for (; i < n; i++) {
+        int32_t v = samples[i];
+        dst[3 * i]     = (uint8_t)v;
+        dst[3 * i + 1] = (uint8_t)(v >> 8);
+        dst[3 * i + 2] = (uint8_t)(v >> 16);
+    }
+}
+
+static void salvar_wav_pcm(const char *filename, int32_t *samples,
+                           uint64_t sample_count, uint32_t sample_rate,
+                           uint16_t channels, uint16_t bps) {
     FILE *f = fopen(filename, "wb");
     if (!f) { perror("Error creating WAV"); return; }
 
-    printf("\nSaving WAV: %u Hz, %u channels, 32-bit...\n",
-           sample_rate, channels);
+    printf("\nSaving WAV: %u Hz, %u channels, %u-bit...\n",
+           sample_rate, channels, bps);
+    if (bps == 16) narrow_to_int16(samples, sample_count);
+    if (bps == 24) narrow_to_int24(samples, sample_count);
 
-    const uint16_t bps       = 32;
     const uint16_t audio_fmt = 1;    /* PCM */
     const uint32_t sub1_sz   = 16;
     uint32_t byte_rate   = sample_rate * channels * (bps / 8);
     uint16_t block_align = (uint16_t)(channels * (bps / 8));
-    uint32_t data_size   = (uint32_t)(sample_count * sizeof(int32_t));
+    uint32_t data_size   = (uint32_t)(sample_count * (bps / 8));
     uint32_t file_size   = 36 + data_size;
 
     uint8_t hdr[44];
@@ -401,25 +1476,127 @@ static void salvar_wav_32bit(const char *filename, int32_t *samples,
     memcpy(hdr + 40, &data_size,4);
 
     fwrite(hdr, 1, 44, f);
-    fwrite(samples, sizeof(int32_t), sample_count, f);
+    fwrite(samples, bps / 8, sample_count, f);
     fclose(f);
 
     printf("WAV saved: %s (%.2f MB)\n", filename,
            (double)data_size / (1024.0 * 1024.0));
 }
 
+/* ============================================================================
+ * MICRO-BENCHMARK: TABELA MULTI-SÍMBOLO × LEITURA BIT A BIT
+ * Decodifica os mesmos streams só até o nível de símbolos, nos dois caminhos,
+ * e confere que ambos produzem exatamente a mesma sequência.
+ * ========================================================================== */
+static double bench_symbol_pass(ChannelDecoder *decs, int num_channels,
+                                int use_table, uint64_t *symbols,
+                                uint64_t *checksum) {
+    uint64_t n = 0, sum = 0;
+    clock_t t0 = clock();
+
+    for (int i = 0; i < num_channels; i++) {
+        ChannelDecoder *dec = &decs[i];
+        uint32_t segments = dec->blocks ? dec->block_count : 1;
+
+        for (uint32_t b = 0; b < segments; b++) {
+            Stream4Bit stream;
+            Predictor  pred;
+            if (dec->blocks) {
+                const TXACBlockEntry *e = &dec->blocks[(size_t)b * dec->block_stride];
+                if (e->bit_size < 8) continue;
+                int type = init_block_stream(&stream, &pred,
+                                             dec->compressed_4bit + (e->byte_offset - dec->data_base),
+                                             e->bit_size, dec->flags);
+                if (type < 0 || type == TXAC_BLOCK_CONSTANT) continue;
+            } else {
+                init_stream(&stream, dec->compressed_4bit, dec->compressed_size);
+            }
+
+            char c;
+            while ((c = use_table ? read_next_char(&stream)
+                                  : read_next_char_bitwise(&stream)) != '\0') {
+                sum = sum * 31 + (uint8_t)c;
+                n++;
+            }
+        }
+    }
+
+    *symbols  = n;
+    *checksum = sum;
+    return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+static void benchmark_symbol_decoders(ChannelDecoder *decs, int num_channels) {
+    if (decs[0].binary) {
+        printf("\nBinary residual file: there is no text symbol layer to benchmark.\n");
+        return;
+    }
+    const int rounds = 5;
+    double best[2] = { 1e30, 1e30 };
+    uint64_t symbols[2] = { 0, 0 }, checksum[2] = { 0, 0 };
+    uint64_t bytes = 0;
+
+    for (int i = 0; i < num_channels; i++) {
+        if (!decs[i].blocks) { bytes += decs[i].compressed_size; continue; }
+        for (uint32_t b = 0; b < decs[i].block_count; b++)
+            bytes += (decs[i].blocks[(size_t)b * decs[i].block_stride].bit_size + 7) / 8;
+    }
+
+    printf("\nSymbol decoder benchmark (%d rounds, best time)...\n", rounds);
+    for (int r = 0; r < rounds; r++) {
+        for (int path = 0; path < 2; path++) {
+            double t = bench_symbol_pass(decs, num_channels, path,
+                                         &symbols[path], &checksum[path]);
+            if (t < best[path]) best[path] = t;
+        }
+    }
+
+    const char *names[2] = { "bit-by-bit read_bit()", "64-bit buffer + table" };
+    for (int path = 0; path < 2; path++) {
+        double t = best[path] > 1e-9 ? best[path] : 1e-9;
+        printf("  %-22s %8.3f s  %8.1f Msym/s  %8.1f MB/s\n", names[path], t,
+               (double)symbols[path] / t / 1e6, (double)bytes / t / (1024.0 * 1024.0));
+    }
+    if (symbols[0] != symbols[1] || checksum[0] != checksum[1])
+        printf("  MISMATCH: the two decoders disagree!\n");
+    else
+        printf("  Same %llu symbols on both paths, speedup %.2fx\n",
+               (unsigned long long)symbols[0],
+               best[0] / (best[1] > 1e-9 ? best[1] : 1e-9));
+}
+
 /* ============================================================================
  * MAIN
  * ========================================================================== */
 int main(int argc, char **argv) {
     if (argc < 3) {
-        printf("Usage:   %s <input.txac> <output.wav>\n", argv[0]);
+        printf("Usage:   %s <input.txac> <output.wav> [--threads N]\n", argv[0]);
+        printf("         %s <input.txac> --bench\n",      argv[0]);
         printf("Example: %s audio.txac  audio.wav\n",     argv[0]);
         return 1;
     }
 
     const char *input  = argv[1];
     const char *output = argv[2];
+    int bench = strcmp(output, "--bench") == 0;
+    int num_threads = 0;   /* 0 = um worker por núcleo */
+
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            long v = strtol(argv[++i], NULL, 10);
+            if (v < 1 || v > 1024) {
+                fprintf(stderr, "Error: --threads must be between 1 and 1024\n");
+                return 1;
+            }
+            num_threads = (int)v;
+        } else {
+            fprintf(stderr, "Error: Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (num_threads == 0) num_threads = detect_cpu_count();
+
+    init_rice_table();
 
     printf("\nTXAC output v0.3.1\n");
     //printf("Input:  %s\n", input);
@@ -429,6 +1606,10 @@ int main(int argc, char **argv) {
     FILE *f = fopen(input, "rb");
     if (!f) { fprintf(stderr, "Error: Cannot open %s\n", input); return 1; }
 
+    /* Header e tabela continuam no fread; os dados comprimidos vêm do mapa */
+    MappedFile map;
+    map_file(f, &map);
+
     char magic[4];
     fread(magic, 1, 4, f);
     if (memcmp(magic, TXAC_MAGIC, 4) != 0) {
@@ -448,6 +1629,11 @@ int main(int argc, char **argv) {
 
     /* Flags — iguais ao txacplay */
     int use_delta    = (hdr.flags & (1 << 1)) != 0;
+    int binary       = (hdr.flags & TXAC_FLAG_BINARY) != 0;
+    int block_params = (hdr.flags & TXAC_FLAG_BLOCK_PARAMS) != 0;
+    int predictors   = (hdr.flags & TXAC_FLAG_PREDICTOR) != 0;
+    int lms          = (hdr.flags & TXAC_FLAG_LMS) != 0;
+    int native       = (hdr.flags & TXAC_FLAG_NATIVE) != 0;
 
     printf(" TXAC Info:\n");
     printf("   Version:         %u\n",   version);
@@ -456,21 +1642,113 @@ int main(int argc, char **argv) {
     printf("   Bits per sample: %u\n",   hdr.bits_per_sample);
     printf("   Total samples:   %llu\n", (unsigned long long)hdr.total_samples);
     //printf("   Loop:            %s\n",   loop_enabled ? "Yes" : "No");
-    printf("   Delta encoding:  %s\n\n", use_delta    ? "Yes" : "No");
+    printf("   Delta encoding:  %s\n",   use_delta    ? "Yes" : "No");
+    printf("   Residual coding: %s%s\n", binary ? "binary (adaptive Rice)" : "text (Rice symbols)",
+           (hdr.flags & TXAC_FLAG_GROUPS) ? " + group back-references" : "");
+    printf("   Rice parameter:  %s\n", block_params ? "per block" : "fixed");
+    printf("   Predictor:       %s%s\n", predictors ? "per block (fixed/LPC)" : "delta",
+           lms ? " + sign-sign LMS cascade" : "");
+    printf("   Sample scale:    %s\n\n", native ? "native integers (lossless)" : "-110 dB (gain on decode)");
+
+    if (native && hdr.bits_per_sample != 16 && hdr.bits_per_sample != 24 &&
+        hdr.bits_per_sample != 32) {
+        fprintf(stderr, "Error: Unsupported native bit depth (%u)\n", hdr.bits_per_sample);
+        fclose(f); return 1;
+    }
 
     if (hdr.channels == 0 || hdr.channels > MAX_CHANNELS) {
         fprintf(stderr, "Error: Unsupported channel count (%u)\n", hdr.channels);
         fclose(f); return 1;
     }
 
-    /* --- Pula reserved bytes e lê índice de canais ----------------------- */
-    fseek(f, 36, SEEK_CUR);
+    /* --- Área reservada: na v5 guarda o descritor da tabela de blocos ---- */
+    if (version > 5) {
+        fprintf(stderr, "Error: Unsupported TXAC version (%u)\n", version);
+        fclose(f); return 1;
+    }
+
+    uint32_t block_size = 0, block_count = 0, pair_mask = 0;
+    uint64_t table_offset = 0;
+    if (version >= 5) {
+        fread(&block_size,   4, 1, f);
+        fread(&block_count,  4, 1, f);
+        fread(&table_offset, 8, 1, f);
+        fread(&pair_mask,    4, 1, f);
+        fseek(f, 16, SEEK_CUR);
+        /* Só pares dentro do arquivo e sem canal repetido valem */
+        if (!(hdr.flags & TXAC_FLAG_STEREO)) pair_mask = 0;
+        if (hdr.channels < 32) pair_mask &= (1u << (hdr.channels - 1)) - 1;
+        if (pair_mask & (pair_mask << 1)) {
+            fprintf(stderr, "Error: Invalid channel pair mask\n");
+            fclose(f); return 1;
+        }
+        if (pair_mask) {
+            printf("Channel pairs:");
+            for (int i = 0; i < (int)hdr.channels; i++)
+                if (pair_mask & (1u << i)) printf(" %d-%d", i, i + 1);
+            printf(" (stereo mode per block)\n");
+        }
+    } else {
+        fseek(f, 36, SEEK_CUR);
+    }
 
     uint64_t offsets[MAX_CHANNELS];
     uint64_t sizes[MAX_CHANNELS];
-    for (int i = 0; i < (int)hdr.channels; i++) {
-        fread(&offsets[i], 8, 1, f);
-        fread(&sizes[i],   8, 1, f);
+    TXACBlockEntry *blocks = NULL;
+    uint8_t *data_region = NULL;
+    uint64_t data_base = 64;
+
+    if (version >= 5) {
+        /* Blocos ficam entre o header e a tabela; lê tudo de uma vez */
+        uint64_t expected = block_size
+            ? (hdr.total_samples + block_size - 1) / block_size : 0;
+        if (block_size == 0 || block_count != expected || table_offset < data_base) {
+            fprintf(stderr, "Error: Invalid block table descriptor\n");
+            fclose(f); return 1;
+        }
+        if (map.data && table_offset > map.size) {
+            fprintf(stderr, "Error: Truncated TXAC file\n");
+            fclose(f); return 1;
+        }
+        size_t entries = (size_t)block_count * hdr.channels;
+        blocks = (TXACBlockEntry *)calloc(entries + 1, sizeof(TXACBlockEntry));
+        if (map.data) {
+            data_region = map.data + data_base;
+        } else {
+            data_region = (uint8_t *)malloc(table_offset - data_base + 1);
+            if (data_region) {
+                fseek(f, (long)data_base, SEEK_SET);
+                fread(data_region, 1, table_offset - data_base, f);
+            }
+        }
+        if (!blocks || !data_region) {
+            fprintf(stderr, "Error: Cannot allocate block table\n");
+            fclose(f); return 1;
+        }
+
+        fseek(f, (long)table_offset, SEEK_SET);
+        for (size_t i = 0; i < entries; i++) {
+            fread(&blocks[i].sample_index, 8, 1, f);
+            fread(&blocks[i].byte_offset,  8, 1, f);
+            fread(&blocks[i].bit_size,     4, 1, f);
+            fread(&blocks[i].sample_count, 4, 1, f);
+
+            TXACBlockEntry *e = &blocks[i];
+            if (e->byte_offset < data_base ||
+                e->byte_offset + (e->bit_size + 7) / 8 > table_offset ||
+                e->sample_count > block_size ||
+                e->sample_index + e->sample_count > hdr.total_samples) {
+                fprintf(stderr, "Error: Corrupt block table entry %zu\n", i);
+                fclose(f); return 1;
+            }
+        }
+        printf("Block index: %u blocks of %u samples per channel\n",
+               block_count, block_size);
+    } else {
+        for (int i = 0; i < (int)hdr.channels; i++) {
+            fread(&offsets[i], 8, 1, f);
+            fread(&sizes[i],   8, 1, f);
+        }
     }
 
     /* --- Aloca e lança threads de decodificação -------------------------- */
@@ -483,43 +1761,131 @@ int main(int argc, char **argv) {
         fclose(f); return 1;
     }
 
-    printf("Starting multi-threaded decompression (%u thread%s)...\n",
-           hdr.channels, hdr.channels == 1 ? "" : "s");
-
     for (int i = 0; i < (int)hdr.channels; i++) {
-        uint64_t per_ch = hdr.total_samples > 0 ? hdr.total_samples : 1024;
-        init_buffer_int32(&cbufs[i], per_ch);
+        if (blocks) {
+            /* v5: o tamanho é conhecido, cada bloco escreve no seu lugar.
+             * calloc deixa zerado qualquer trecho que a tabela não cubra. */
+            cbufs[i].data = (int32_t *)calloc(hdr.total_samples ? hdr.total_samples : 1,
+                                              sizeof(int32_t));
+            if (!cbufs[i].data) {
+                fprintf(stderr, "Fatal: Cannot allocate channel buffer\n");
+                exit(1);
+            }
+            cbufs[i].capacity = hdr.total_samples;
+            cbufs[i].count    = hdr.total_samples;
+        } else {
+            uint64_t per_ch = hdr.total_samples > 0 ? hdr.total_samples : 1024;
+            init_buffer_int32(&cbufs[i], per_ch);
+        }
 
         decoders[i].channel_id         = i;
         decoders[i].output_buffer      = &cbufs[i];
-        decoders[i].compressed_size    = sizes[i];
         decoders[i].use_delta_encoding = use_delta;
+        decoders[i].binary             = binary;
+        decoders[i].flags              = hdr.flags;
+        if (!(pair_mask & (1u << i)))
+            decoders[i].flags &= ~(uint32_t)TXAC_FLAG_STEREO;
         decoders[i].finished           = 0;
 
-        decoders[i].compressed_4bit = (uint8_t *)malloc(sizes[i]);
-        if (!decoders[i].compressed_4bit) {
-            fprintf(stderr, "Error: Cannot allocate memory for channel %d\n", i);
-            fclose(f); return 1;
+        if (blocks) {
+            decoders[i].compressed_4bit = data_region;
+            decoders[i].compressed_size = table_offset - data_base;
+            decoders[i].blocks          = blocks + i;
+            decoders[i].block_count     = block_count;
+            decoders[i].block_stride    = hdr.channels;
+            decoders[i].data_base       = data_base;
+        } else {
+            decoders[i].compressed_size = sizes[i];
+            if (map.data) {
+                if (offsets[i] > map.size || sizes[i] > map.size - offsets[i]) {
+                    fprintf(stderr, "Error: Truncated TXAC file (channel %d)\n", i);
+                    fclose(f); return 1;
+                }
+                decoders[i].compressed_4bit = map.data + offsets[i];
+            } else {
+                decoders[i].compressed_4bit = (uint8_t *)malloc(sizes[i]);
+                if (!decoders[i].compressed_4bit) {
+                    fprintf(stderr, "Error: Cannot allocate memory for channel %d\n", i);
+                    fclose(f); return 1;
+                }
+                fseek(f, (long)offsets[i], SEEK_SET);
+                fread(decoders[i].compressed_4bit, 1, sizes[i], f);
+            }
         }
-        fseek(f, (long)offsets[i], SEEK_SET);
-        fread(decoders[i].compressed_4bit, 1, sizes[i], f);
+    }
 
-        pthread_create(&decoders[i].thread, NULL,
-                       decoder_thread_func, &decoders[i]);
+    if (bench) {
+        benchmark_symbol_decoders(decoders, (int)hdr.channels);
+        for (int i = 0; i < (int)hdr.channels; i++) {
+            if (!blocks && !map.data) free(decoders[i].compressed_4bit);
+            free(cbufs[i].data);
+        }
+        if (!map.data) free(data_region);
+        unmap_file(&map);
+        free(blocks);
+        free(cbufs);
+        free(decoders);
+        fclose(f);
+        return 0;
     }
 
-    for (int i = 0; i < (int)hdr.channels; i++) {
-        pthread_join(decoders[i].thread, NULL);
-        free(decoders[i].compressed_4bit);
+    /* --- Decodificação paralela ----------------------------------------- */
+    /* v5: cada canal é fatiado em segmentos de blocos (~4 por worker no
+     * total), então até um arquivo mono usa todos os núcleos. v4 não tem
+     * pontos de reinício: uma tarefa por canal. */
+    ThreadPool pool;
+    pool_init(&pool, num_threads);
+    printf("Starting multi-threaded decompression (%d thread%s)...\n",
+           num_threads, num_threads == 1 ? "" : "s");
+
+    DecodeSegment *segments = NULL;
+    if (blocks) {
+        uint64_t target    = (uint64_t)num_threads * 4;
+        uint64_t per_ch    = (target + hdr.channels - 1) / hdr.channels;
+        uint32_t seg_blocks = (uint32_t)((block_count + per_ch - 1) / per_ch);
+        if (seg_blocks == 0) seg_blocks = 1;
+        uint32_t segs_per_ch = (block_count + seg_blocks - 1) / seg_blocks;
+
+        segments = (DecodeSegment *)calloc((size_t)segs_per_ch * hdr.channels + 1,
+                                           sizeof(DecodeSegment));
+        if (!segments) { fprintf(stderr, "Fatal: No RAM for decode tasks\n"); exit(1); }
+
+        size_t t = 0;
+        for (uint32_t s0 = 0; s0 < block_count; s0 += seg_blocks) {
+            for (int c = 0; c < (int)hdr.channels; c++) {
+                /* O canal da direita de um par sai junto com o da esquerda */
+                if (c > 0 && (pair_mask & (1u << (c - 1)))) continue;
+                segments[t].dec         = &decoders[c];
+                segments[t].pair        = (pair_mask & (1u << c)) ? &decoders[c + 1] : NULL;
+                segments[t].first_block = s0;
+                segments[t].block_count = block_count - s0 < seg_blocks
+                                        ? block_count - s0 : seg_blocks;
+                pool_submit(&pool, decode_segment_task, &segments[t++]);
+            }
+        }
+        printf("  %zu segments of up to %u blocks across %u channel%s\n",
+               t, seg_blocks, hdr.channels, hdr.channels == 1 ? "" : "s");
+    } else {
+        for (int i = 0; i < (int)hdr.channels; i++)
+            pool_submit(&pool, decoder_channel_task, &decoders[i]);
     }
+    pool_wait(&pool);
+    free(segments);
+
+    for (int i = 0; i < (int)hdr.channels; i++)
+        if (!blocks && !map.data) free(decoders[i].compressed_4bit);
+    if (!map.data) free(data_region);
+    unmap_file(&map);
+    free(blocks);
     fclose(f);
 
     /* --- Intercala e salva WAV ------------------------------------------- */
     uint64_t total_samples;
     int32_t *interleaved = intercalar_canais(cbufs, (int)hdr.channels,
-                                             &total_samples);
-    salvar_wav_32bit(output, interleaved, total_samples,
-                     hdr.sample_rate, hdr.channels);
+                                             &total_samples, &pool);
+    pool_destroy(&pool);
+    salvar_wav_pcm(output, interleaved, total_samples, hdr.sample_rate, hdr.channels,
+                   native ? hdr.bits_per_sample : 32);
 
     /* --- Cleanup ---------------------------------------------------------- */
     for (int i = 0; i < (int)hdr.channels; i++) free(cbufs[i].data);
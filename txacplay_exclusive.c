@@ -4,6 +4,8 @@ TXAC Player v14.0 - 14-bit Packed Buffer + On-the-fly Float Conversion
 - Conversão 14bit → float ocorre ao vivo no callback do sokol, sem armazenar float na RAM
 - Delta decoding produz int32 → clampado para 14 bits → empacotado no bitstream
 - ~56% de economia de RAM em relação ao buffer float anterior (4 bytes/sample → 1.75)
+- Arquivos v5 tocam em streaming: uma thread produtora decodifica à frente num
+  anel SPSC de chunks; a RAM usada não depende da duração da faixa
 */
 
 #include <stdio.h>
@@ -11,6 +13,7 @@ TXAC Player v14.0 - 14-bit Packed Buffer + On-the-fly Float Conversion
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include <immintrin.h>
 
 #define MINIAUDIO_IMPLEMENTATION
@@ -20,6 +23,7 @@ TXAC Player v14.0 - 14-bit Packed Buffer + On-the-fly Float Conversion
 #if defined(_WIN32)
     #include <windows.h>
     #include <conio.h>
+    #include <io.h>
     #define THREAD_SLEEP_MS(ms) Sleep(ms)
     #define getch _getch  // Resolve o erro de 'undeclared getch'
     typedef HANDLE thread_ptr;
@@ -29,6 +33,8 @@ TXAC Player v14.0 - 14-bit Packed Buffer + On-the-fly Float Conversion
     #include <pthread.h>
     #include <unistd.h>
     #include <termios.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
     #define THREAD_SLEEP_MS(ms) usleep((ms) * 1000)
     typedef pthread_t thread_ptr;
     #define CREATE_THREAD(ptr, func, arg) pthread_create(ptr, NULL, func, arg)
@@ -64,6 +70,28 @@ typedef struct {
     uint64_t total_samples;
 } TXACHeader;
 
+// Entrada da tabela de blocos (v5). Todo bloco começa com acumulador zerado.
+typedef struct {
+    uint64_t sample_index;  // primeira amostra do bloco dentro do canal
+    uint64_t byte_offset;   // posição absoluta no arquivo
+    uint32_t bit_size;      // header do bloco + Rice, em bits
+    uint32_t sample_count;
+} TXACBlockEntry;
+
+#define TXAC_BLOCK_TOKENS 0 // tipo de bloco: fluxo de tokens em Rice
+#define TXAC_BLOCK_GROUPS 1 // tipo de bloco: tokens com grupos '(' (TXAC_FLAG_GROUPS)
+#define TXAC_BLOCK_CONSTANT 2 // tipo de bloco: um único valor int32 (TXAC_FLAG_CONSTANT)
+#define TXAC_FLAG_BINARY (1 << 2) // resíduos em Rice adaptativo, sem camada de texto
+#define TXAC_FLAG_BLOCK_PARAMS (1 << 3) // 2º byte do bloco = parâmetro Rice do bloco
+#define TXAC_FLAG_PREDICTOR (1 << 4)    // header do bloco traz o preditor
+#define TXAC_FLAG_LMS (1 << 5)          // header do bloco traz os estágios LMS
+#define TXAC_FLAG_STEREO (1 << 6)       // pares acoplados: header do bloco traz o modo
+#define TXAC_FLAG_GROUPS (1 << 7)       // pode haver blocos TXAC_BLOCK_GROUPS
+#define TXAC_FLAG_CONSTANT (1 << 8)     // pode haver blocos TXAC_BLOCK_CONSTANT
+#define TXAC_FLAG_NATIVE (1 << 9)       // inteiros em bits_per_sample, sem o ganho de 110 dB
+#define TXAC_FLAG_WASTED (1 << 10)      // bit 6 do preditor: bits desperdiçados do bloco
+#define RICE_MAX_K 3              // maior k dos símbolos de texto
+
 // ============================================================================
 // BUFFER INT32 INTERMEDIÁRIO (usado internamente no parsing, não armazenado)
 // ============================================================================
@@ -205,18 +233,77 @@ static inline void push_value_14bit(Buffer14Bit *buf, int32_t value) {
 typedef struct {
     uint8_t *raw_data;
     size_t byte_count;
+    size_t bit_limit; // Fim lógico do stream (blocos v5 ignoram o padding)
     size_t bit_pos; // Mudamos de byte_pos para bit_pos
+    // Caminho rápido: bit-buffer de 64 bits recarregado uma palavra por vez
+    // e símbolos já decodificados pela tabela multi-símbolo
+    uint64_t bit_buf;
+    unsigned bit_avail;
+    size_t next_byte;
+    uint32_t pending_syms; // 4 bits por símbolo, o próximo nos bits baixos
+    unsigned pending_count;
+    unsigned rice_k;             // k do bloco (texto) ou k inicial (binário)
+    unsigned groups;              // bloco TXAC_BLOCK_GROUPS (binário: s == 0 traz o bit run/grupo)
+    const uint32_t *table;       // tabela multi-símbolo do k atual
 } Stream4Bit;
 
+static inline void stream_refill(Stream4Bit *s) {
+    if (s->next_byte + 8 <= s->byte_count) {
+        uint64_t word;
+        memcpy(&word, s->raw_data + s->next_byte, 8);
+        s->bit_buf |= __builtin_bswap64(word) >> s->bit_avail;
+        unsigned take = (63 - s->bit_avail) >> 3;
+        s->next_byte += take;
+        s->bit_avail += take * 8;
+    } else {
+        while (s->bit_avail <= 56 && s->next_byte < s->byte_count) {
+            s->bit_buf |= (uint64_t)s->raw_data[s->next_byte++] << (56 - s->bit_avail);
+            s->bit_avail += 8;
+        }
+    }
+}
+
+// Realinha o bit-buffer com bit_pos depois de uma leitura bit a bit
+static void stream_resync(Stream4Bit *s) {
+    s->next_byte = s->bit_pos / 8;
+    s->bit_buf = 0;
+    s->bit_avail = 0;
+    stream_refill(s);
+    unsigned skip = (unsigned)(s->bit_pos % 8);
+    s->bit_buf <<= skip;
+    s->bit_avail -= skip;
+}
+
+#define RICE_TABLE_BITS 12
+#define RICE_TABLE_MAX_SYMS 6
+
+static uint32_t rice_table[RICE_MAX_K + 1][1 << RICE_TABLE_BITS];
+
 void init_stream(Stream4Bit *s, uint8_t *data, size_t size) {
     s->raw_data = data;
     s->byte_count = size;
+    s->bit_limit = size * 8;
     s->bit_pos = 0;
+    s->pending_syms = 0;
+    s->pending_count = 0;
+    s->rice_k = 1;               // v4 e v5 sem TXAC_FLAG_BLOCK_PARAMS
+    s->groups = 0;
+    s->table = rice_table[1];
+    stream_resync(s);
+}
+
+void init_stream_bits(Stream4Bit *s, uint8_t *data, size_t bits) {
+    init_stream(s, data, (bits + 7) / 8);
+    s->bit_limit = bits;
+}
+
+static inline int stream_has_data(const Stream4Bit *s) {
+    return s->pending_count != 0 || s->bit_pos < s->bit_limit;
 }
 
 // Lê 1 bit do buffer e avança o cursor
 static inline int read_bit(Stream4Bit *s) {
-    if (s->bit_pos >= s->byte_count * 8) return -1;
+    if (s->bit_pos >= s->bit_limit) return -1;
     
     int byte_idx = s->bit_pos / 8;
     int bit_off  = 7 - (s->bit_pos % 8); // MSB para LSB
@@ -237,10 +324,12 @@ static inline uint32_t read_bits(Stream4Bit *s, int count) {
     return value;
 }
 
-char read_next_char(Stream4Bit *s) {
-    if (s->bit_pos >= s->byte_count * 8) return '\0';
+// Decodificador bit a bit: usado só no fim do stream e para códigos que não
+// cabem na janela da tabela (dados corrompidos)
+char read_next_char_bitwise(Stream4Bit *s) {
+    if (s->bit_pos >= s->bit_limit) return '\0';
 
-    int k = 1; // DEVE ser o mesmo k usado no encoder
+    int k = (int)s->rice_k; // k do bloco, o mesmo usado no encoder
     
     // 1. Decodifica o Quociente (Unário: sequência de 1s terminada em 0)
     uint32_t q = 0;
@@ -264,6 +353,68 @@ char read_next_char(Stream4Bit *s) {
     return simbolos[symbol_idx];
 }
 
+// ============================================================================
+// TABELA MULTI-SÍMBOLO
+// Uma tabela por k (0..RICE_MAX_K), indexada pelos próximos RICE_TABLE_BITS
+// bits; cada consulta devolve até 6 símbolos completos:
+//   bits 0-3: comprimento consumido, bits 4-6: quantidade de símbolos,
+//   bits 8+: índices de 4 bits (o primeiro nos bits baixos).
+// Comprimento 0 = o código não cabe na janela -> caminho bit a bit.
+// ============================================================================
+static void init_rice_table_k(uint32_t *table, unsigned k) {
+    for (uint32_t idx = 0; idx < (1u << RICE_TABLE_BITS); idx++) {
+        unsigned used = 0, count = 0;
+        uint32_t syms = 0;
+        while (count < RICE_TABLE_MAX_SYMS) {
+            unsigned q = 0, pos = used;
+            while (pos < RICE_TABLE_BITS && ((idx >> (RICE_TABLE_BITS - 1 - pos)) & 1)) {
+                q++;
+                pos++;
+            }
+            if (pos + 1 + k > RICE_TABLE_BITS) break; // código incompleto
+            pos++;                                    // zero terminador
+            uint32_t r = (idx >> (RICE_TABLE_BITS - pos - k)) & ((1u << k) - 1);
+            pos += k;
+            uint32_t sym = (q << k) | r;
+            if (sym >= 16) sym = 0;                   // igual ao bit a bit: ','
+            syms |= sym << (4 * count);
+            count++;
+            used = pos;
+        }
+        table[idx] = count ? (used | (count << 4) | (syms << 8)) : 0;
+    }
+}
+
+void init_rice_table(void) {
+    for (unsigned k = 0; k <= RICE_MAX_K; k++)
+        init_rice_table_k(rice_table[k], k);
+}
+
+static inline char read_next_char(Stream4Bit *s) {
+    if (s->pending_count == 0) {
+        if (s->bit_pos >= s->bit_limit) return '\0';
+        if (s->bit_avail < RICE_TABLE_BITS) stream_refill(s);
+
+        uint32_t e = s->table[s->bit_buf >> (64 - RICE_TABLE_BITS)];
+        unsigned len = e & 0xF;
+        if (len == 0 || len > s->bit_limit - s->bit_pos) {
+            char c = read_next_char_bitwise(s);
+            stream_resync(s);
+            return c;
+        }
+        s->bit_buf <<= len;
+        s->bit_avail -= len;
+        s->bit_pos += len;
+        s->pending_syms = e >> 8;
+        s->pending_count = (e >> 4) & 7;
+    }
+
+    s->pending_count--;
+    char c = simbolos[s->pending_syms & 0xF];
+    s->pending_syms >>= 4;
+    return c;
+}
+
 typedef struct {
     int32_t value;
     uint32_t argument;
@@ -277,26 +428,31 @@ static int read_token_stream(Stream4Bit *s, ParsedToken *token) {
     int negative = 0;
     int have_value = 0;
     int have_argument = 0;
+    int group = 0;
     char operation = '\0';
     char c;
 
     while ((c = read_next_char(s)) != '\0' && c != ',') {
-        if (c == '(' || c == ')') continue;
-        if (!have_value && c == '-') {
+        if (c == '(' && !have_value && !negative && !group) {
+            group = 1;   // "(D)N": D vai em value e N em argument
+        } else if (c == ')' && group && have_value && !operation) {
+            operation = '(';
+        } else if (!have_value && !group && c == '-') {
             negative = 1;
         } else if (c >= '0' && c <= '9') {
             uint64_t *destination = operation ? &argument : &value;
             *destination = *destination * 10 + (uint64_t)(c - '0');
             if (operation) have_argument = 1;
             else have_value = 1;
-        } else if ((c == '^' || c == '~') && have_value && !operation) {
+        } else if ((c == '^' || c == '~') && have_value && !operation && !group) {
             operation = c;
         } else {
             return -1;
         }
     }
 
-    if (!have_value) return 0;
+    if (!have_value) return group ? -1 : 0;
+    if (group && operation != '(') return -1;
     if (operation && !have_argument) return -1;
     if ((!negative && value > INT32_MAX) ||
         (negative && value > UINT64_C(2147483648)) ||
@@ -308,6 +464,440 @@ static int read_token_stream(Stream4Bit *s, ParsedToken *token) {
     return 1;
 }
 
+// ============================================================================
+// MODO BINÁRIO (TXAC_FLAG_BINARY)
+// Cada token é um código Rice de s com k adaptativo (espelho do encoder):
+//   s >= 2  → valor simples, zigzag(valor) = s - 2
+//   s == 0  → run '^':    Rice(zigzag(valor)) + Exp-Golomb(repetições - 2)
+//   s == 1  → sniper '~': Rice(zigzag(valor)) + Exp-Golomb(buraco)
+// Nos blocos TXAC_BLOCK_GROUPS o s == 0 traz mais 1 bit: 0 = run, 1 = grupo '(':
+//   Exp-Golomb(distância - 1) + Exp-Golomb(N - GROUP_MIN_LEN)
+// k vem da média móvel dos zigzag do bloco; nada de dígitos decimais.
+// ============================================================================
+#define RESIDUAL_K0   4    // k inicial de cada bloco
+#define RICE_ESCAPE_Q 24   // quociente de escape: comprimento em 6 bits + valor cru
+#define GROUP_MIN_LEN 3    // menor grupo '(' do modo binário
+
+static inline unsigned residual_k(uint64_t mean16) {
+    uint64_t avg = mean16 >> 4;
+    return avg ? 63 - (unsigned)__builtin_clzll(avg) : 0;
+}
+
+// Consome n bits (n <= 56) do bit-buffer; -1 se o stream acabar antes
+static inline int stream_take(Stream4Bit *s, unsigned n, uint64_t *out) {
+    if (n > s->bit_limit - s->bit_pos) { s->bit_pos = s->bit_limit; return -1; }
+    if (n == 0) { *out = 0; return 0; }
+    if (s->bit_avail < n) stream_refill(s);
+    *out = s->bit_buf >> (64 - n);
+    s->bit_buf   <<= n;
+    s->bit_avail  -= n;
+    s->bit_pos    += n;
+    return 0;
+}
+
+static inline int read_rice_adaptive(Stream4Bit *s, unsigned k, uint64_t *out) {
+    if (s->bit_avail < RICE_ESCAPE_Q + 1) stream_refill(s);
+    unsigned ones = (unsigned)__builtin_clzll(~s->bit_buf | 1);
+    unsigned q    = ones < RICE_ESCAPE_Q ? ones : RICE_ESCAPE_Q;
+    uint64_t bits;
+    // Quociente unário (+ zero terminador, exceto no escape)
+    if (stream_take(s, q < RICE_ESCAPE_Q ? q + 1 : q, &bits) < 0) return -1;
+
+    if (q == RICE_ESCAPE_Q) {
+        uint64_t len;
+        if (stream_take(s, 6, &len) < 0) return -1;
+        if (len == 0 || len > 40) { s->bit_pos = s->bit_limit; return -1; }
+        return stream_take(s, (unsigned)len, out);
+    }
+
+    uint64_t r;
+    if (stream_take(s, k, &r) < 0) return -1;
+    *out = ((uint64_t)q << k) | r;
+    return 0;
+}
+
+static inline int read_expgolomb(Stream4Bit *s, uint64_t *n) {
+    if (s->bit_avail < 56) stream_refill(s);
+    unsigned zeros = s->bit_buf ? (unsigned)__builtin_clzll(s->bit_buf) : 64;
+    uint64_t x;
+    if (zeros > 34) { s->bit_pos = s->bit_limit; return -1; }
+    if (stream_take(s, zeros, &x) < 0 || stream_take(s, zeros + 1, &x) < 0) return -1;
+    *n = x - 1;
+    return 0;
+}
+
+// Mesmo contrato de read_token_stream: 1 = token, 0 = fim, -1 = inválido
+static int read_token_binary(Stream4Bit *s, uint64_t *mean16, ParsedToken *token) {
+    if (s->bit_pos >= s->bit_limit) return 0;
+
+    unsigned k = residual_k(*mean16);
+    uint64_t sym, z, argument = 0;
+    char operation = '\0';
+
+    if (read_rice_adaptive(s, k, &sym) < 0) return -1;
+    uint64_t is_group = 0;
+    if (sym == 0 && s->groups && stream_take(s, 1, &is_group) < 0) return -1;
+    if (is_group) {
+        // Grupo: distância e N, sem valor; a média móvel não muda
+        uint64_t dist;
+        if (read_expgolomb(s, &dist) < 0 || read_expgolomb(s, &argument) < 0) return -1;
+        argument += GROUP_MIN_LEN;
+        if (dist >= INT32_MAX || argument > UINT32_MAX) return -1;
+        token->value     = (int32_t)(dist + 1);
+        token->argument  = (uint32_t)argument;
+        token->operation = '(';
+        return 1;
+    }
+    if (sym >= 2) {
+        z = sym - 2;
+    } else {
+        operation = sym == 0 ? '^' : '~';
+        if (read_rice_adaptive(s, k, &z) < 0 || read_expgolomb(s, &argument) < 0)
+            return -1;
+        if (operation == '^') argument += 2;
+    }
+    *mean16 += z - (*mean16 >> 4);
+
+    if (z > UINT32_MAX || argument > UINT32_MAX) return -1;
+    token->value     = (int32_t)((uint32_t)(z >> 1) ^ (0u - (uint32_t)(z & 1)));
+    token->argument  = (uint32_t)argument;
+    token->operation = operation;
+    return 1;
+}
+
+// ============================================================================
+// PREDITOR DO BLOCO (TXAC_FLAG_PREDICTOR)
+// amostra[i] = resíduo[i] + (Σ coef[j] * amostra[i-1-j]) >> shift, com a soma
+// em int32 (wrap-around) e amostras anteriores ao bloco valendo 0. Polinômios
+// fixos de ordem 0..4 usam shift 0; o LPC traz shift e coeficientes int16 no
+// header, e o encoder garante que a soma dele cabe em 32 bits.
+// Sem a flag o bloco é ordem 1 (delta) ou 0, conforme o flag bit 1.
+// ============================================================================
+#define FIXED_MAX_ORDER 4
+#define LPC_MAX_ORDER   32
+
+typedef struct {
+    uint8_t order;
+    uint8_t lpc;
+    uint8_t shift;
+    uint8_t lms_stages;  // estágios LMS a desfazer antes do preditor
+    uint8_t stereo;      // modo estéreo do par (canal da esquerda)
+    int32_t constant;    // valor de todas as amostras de um TXAC_BLOCK_CONSTANT
+    uint8_t wasted;      // bits zero devolvidos no fim do bloco (<< depois do preditor)
+    int32_t coef[LPC_MAX_ORDER];
+} Predictor;
+
+static const int32_t fixed_coefs[FIXED_MAX_ORDER + 1][FIXED_MAX_ORDER] = {
+    { 0 },
+    { 1 },
+    { 2, -1 },
+    { 3, -3, 1 },
+    { 4, -6, 4, -1 }
+};
+
+static void predictor_fixed(Predictor *p, unsigned order) {
+    memset(p, 0, sizeof(*p));
+    p->order = (uint8_t)order;
+    for (unsigned j = 0; j < order; j++) p->coef[j] = fixed_coefs[order][j];
+}
+
+// Lê o preditor em payload[0..avail); devolve os bytes usados ou -1
+static int predictor_read_header(Predictor *p, const uint8_t *payload, size_t avail) {
+    if (avail < 1) return -1;
+    unsigned order = payload[0] & 0x3F;
+    size_t used;
+    if (!(payload[0] & 0x80)) {
+        if (order > FIXED_MAX_ORDER) return -1;
+        predictor_fixed(p, order);
+        used = 1;
+    } else {
+        if (order == 0 || order > LPC_MAX_ORDER || avail < 2 + 2 * (size_t)order) return -1;
+        if (payload[1] > 31) return -1;
+        memset(p, 0, sizeof(*p));
+        p->order = (uint8_t)order;
+        p->lpc   = 1;
+        p->shift = payload[1];
+        for (unsigned j = 0; j < order; j++)
+            p->coef[j] = (int16_t)(payload[2 + 2 * j] | (payload[3 + 2 * j] << 8));
+        used = 2 + 2 * (size_t)order;
+    }
+    if (payload[0] & 0x40) {
+        if (avail < used + 1 || payload[used] == 0 || payload[used] > 31) return -1;
+        p->wasted = payload[used++];
+    }
+    return (int)used;
+}
+
+// Ordem curta: com 'order' constante o compilador desenrola o produto escalar
+static inline __attribute__((always_inline))
+void restore_short(int32_t *x, size_t i, size_t n, const int32_t *coef,
+                   unsigned order, unsigned shift) {
+    for (; i < n; i++) {
+        const int32_t *h = x + i - 1;
+        uint32_t sum = 0;
+        for (unsigned j = 0; j < order; j++) sum += (uint32_t)coef[j] * (uint32_t)h[-(ptrdiff_t)j];
+        x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)((int32_t)sum >> shift));
+    }
+}
+
+// Reconstrói as amostras do bloco no próprio buffer de resíduos
+static void restore_prediction(int32_t *x, size_t n, const Predictor *p) {
+    const unsigned order = p->order, shift = p->shift;
+    const int32_t *c = p->coef;
+    if (order == 0) return;
+
+    if (!p->lpc && order == 1) {
+        uint32_t acc = 0;
+        for (size_t i = 0; i < n; i++) x[i] = (int32_t)(acc += (uint32_t)x[i]);
+        return;
+    }
+
+    // Aquecimento: só as amostras do próprio bloco entram na soma
+    size_t i = 0;
+    for (; i < n && i < order; i++) {
+        uint32_t sum = 0;
+        for (unsigned j = 0; j < i; j++) sum += (uint32_t)c[j] * (uint32_t)x[i - 1 - j];
+        x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)((int32_t)sum >> shift));
+    }
+
+    switch (order) {
+    case 1: restore_short(x, i, n, c, 1, shift); return;
+    case 2: restore_short(x, i, n, c, 2, shift); return;
+    case 3: restore_short(x, i, n, c, 3, shift); return;
+    case 4: restore_short(x, i, n, c, 4, shift); return;
+    case 5: restore_short(x, i, n, c, 5, shift); return;
+    case 6: restore_short(x, i, n, c, 6, shift); return;
+    case 7: restore_short(x, i, n, c, 7, shift); return;
+    case 8: restore_short(x, i, n, c, 8, shift); return;
+    default: break;
+    }
+
+    // Ordem > 8, de 8 em 8 amostras: os coeficientes 8.. só tocam amostras já
+// prontas, então essa parte sai em AVX2 para as 8 de uma vez; os 8 mais
+// recentes fecham a soma em escalar, amostra por amostra.
+    uint32_t part[8] __attribute__((aligned(32)));
+    for (; i + 8 <= n; i += 8) {
+        __m256i acc = _mm256_setzero_si256();
+        for (unsigned j = 8; j < order; j++)
+            acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(_mm256_set1_epi32(c[j]),
+                      _mm256_loadu_si256((const __m256i *)(x + i - 1 - j))));
+        _mm256_store_si256((__m256i *)part, acc);
+        for (unsigned k = 0; k < 8; k++) {
+            const int32_t *h = x + i + k - 1;
+            uint32_t sum = part[k];
+            for (unsigned j = 0; j < 8; j++) sum += (uint32_t)c[j] * (uint32_t)h[-(ptrdiff_t)j];
+            x[i + k] = (int32_t)((uint32_t)x[i + k] + (uint32_t)((int32_t)sum >> shift));
+        }
+    }
+    for (; i < n; i++) {
+        uint32_t sum = 0;
+        for (unsigned j = 0; j < order; j++) sum += (uint32_t)c[j] * (uint32_t)x[i - 1 - j];
+        x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)((int32_t)sum >> shift));
+    }
+}
+
+// Devolve os bits desperdiçados do bloco depois do preditor, 8 por vez
+static void restore_wasted(int32_t *x, size_t n, unsigned wasted) {
+    if (!wasted) return;
+    __m128i count = _mm_cvtsi32_si128((int)wasted);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(x + i),
+                            _mm256_sll_epi32(_mm256_loadu_si256((const __m256i *)(x + i)), count));
+    for (; i < n; i++) x[i] = (int32_t)((uint32_t)x[i] << wasted);
+}
+
+// ============================================================================
+// CASCATA SIGN-SIGN LMS (TXAC_FLAG_LMS, encoder --best)
+// Depois do preditor, o encoder pode ter passado os resíduos do bloco por
+// filtros adaptativos em série; o byte de estágios no header diz quantos.
+// Cada estágio prevê a sua entrada pelas últimas 'order' entradas saturadas em
+// int16 (pmaddwd) e ajusta os pesos int16 só pelos sinais:
+//   w[j] += sign(erro) * sign(entrada[i-1-j]) * LMS_STEP
+// O estado zera em cada bloco. Aqui os estágios são desfeitos do último para
+// o primeiro, com as mesmas contas inteiras do encoder (bit a bit).
+// ============================================================================
+#define LMS_STAGES    2
+#define LMS_MAX_ORDER 64
+#define LMS_STEP      2
+
+static const struct { unsigned order, shift; } lms_cascade[LMS_STAGES] = {
+    { 64, 11 },
+    { 16, 10 }
+};
+
+static inline int16_t lms_sat16(int32_t v) {
+    return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+static inline int32_t lms_dot(const int16_t *w, const int16_t *h, unsigned order) {
+    __m256i acc = _mm256_setzero_si256();
+    for (unsigned j = 0; j < order; j += 16)
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+                  _mm256_load_si256((const __m256i *)(w + j)),
+                  _mm256_loadu_si256((const __m256i *)(h + j))));
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+
+static inline void lms_adapt(int16_t *w, const int16_t *sgn, unsigned order, int32_t err) {
+    for (unsigned j = 0; j < order; j += 16) {
+        __m256i wv = _mm256_load_si256((const __m256i *)(w + j));
+        __m256i sv = _mm256_loadu_si256((const __m256i *)(sgn + j));
+        wv = err > 0 ? _mm256_add_epi16(wv, sv) : _mm256_sub_epi16(wv, sv);
+        _mm256_store_si256((__m256i *)(w + j), wv);
+    }
+}
+
+// Desfaz um estágio no lugar: x (erro) volta a ser a entrada do estágio.
+// hist/sgn precisam de n + order posições.
+static void lms_undo_stage(int32_t *x, size_t n, unsigned order, unsigned shift,
+                           int16_t *hist, int16_t *sgn) {
+    int16_t w[LMS_MAX_ORDER] __attribute__((aligned(32)));
+    memset(w, 0, sizeof(w));
+    memset(hist, 0, order * sizeof(int16_t));
+    memset(sgn, 0, order * sizeof(int16_t));
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t pred = (uint32_t)(lms_dot(w, hist + i, order) >> shift);
+        int32_t  err  = x[i];
+        int32_t  in   = (int32_t)((uint32_t)err + pred);
+        x[i] = in;
+        if (err != 0) lms_adapt(w, sgn + i, order, err);
+        hist[i + order] = lms_sat16(in);
+        sgn[i + order]  = (int16_t)(in > 0 ? LMS_STEP : in < 0 ? -LMS_STEP : 0);
+    }
+}
+
+// Desfaz 'stages' estágios da cascata; devolve -1 sem memória
+static int lms_restore(int32_t *x, size_t n, unsigned stages) {
+    if (stages == 0 || n == 0) return 0;
+    int16_t *hist = (int16_t *)malloc((n + LMS_MAX_ORDER) * sizeof(int16_t));
+    int16_t *sgn  = (int16_t *)malloc((n + LMS_MAX_ORDER) * sizeof(int16_t));
+    if (!hist || !sgn) {
+        free(hist);
+        free(sgn);
+        return -1;
+    }
+    for (unsigned st = stages; st-- > 0;)
+        lms_undo_stage(x, n, lms_cascade[st].order, lms_cascade[st].shift, hist, sgn);
+    free(hist);
+    free(sgn);
+    return 0;
+}
+
+// ============================================================================
+// ACOPLAMENTO ESTÉREO (TXAC_FLAG_STEREO)
+// Pares de canais vizinhos (máscara no header, bit i = canais i e i+1) trazem
+// o modo do bloco no header do bloco do canal da esquerda:
+//   0 = L/R   1 = L/S   2 = S/R   3 = M/S,  com S = L - R e M = (L + R) >> 1
+// Desfeito em AVX2 depois do preditor, antes do ganho e da intercalação.
+// ============================================================================
+#define STEREO_INDEPENDENT 0
+#define STEREO_LEFT_SIDE   1
+#define STEREO_SIDE_RIGHT  2
+#define STEREO_MID_SIDE    3
+
+// a/b entram com os sinais do modo e saem como L/R, 8 amostras por vez
+static void stereo_undo(int32_t *a, int32_t *b, size_t n, unsigned mode) {
+    const __m256i one = _mm256_set1_epi32(1);
+    size_t i = 0;
+    switch (mode) {
+    case STEREO_LEFT_SIDE:   // R = L - S
+        for (; i + 8 <= n; i += 8) {
+            __m256i l = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i s = _mm256_loadu_si256((const __m256i *)(b + i));
+            _mm256_storeu_si256((__m256i *)(b + i), _mm256_sub_epi32(l, s));
+        }
+        for (; i < n; i++) b[i] = (int32_t)((uint32_t)a[i] - (uint32_t)b[i]);
+        break;
+    case STEREO_SIDE_RIGHT:  // L = S + R
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i r = _mm256_loadu_si256((const __m256i *)(b + i));
+            _mm256_storeu_si256((__m256i *)(a + i), _mm256_add_epi32(s, r));
+        }
+        for (; i < n; i++) a[i] = (int32_t)((uint32_t)a[i] + (uint32_t)b[i]);
+        break;
+    case STEREO_MID_SIDE:    // L = M + (S >> 1) + (S & 1), R = L - S
+        for (; i + 8 <= n; i += 8) {
+            __m256i m = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i s = _mm256_loadu_si256((const __m256i *)(b + i));
+            __m256i l = _mm256_add_epi32(_mm256_add_epi32(m, _mm256_srai_epi32(s, 1)),
+                                         _mm256_and_si256(s, one));
+            _mm256_storeu_si256((__m256i *)(a + i), l);
+            _mm256_storeu_si256((__m256i *)(b + i), _mm256_sub_epi32(l, s));
+        }
+        for (; i < n; i++) {
+            int32_t s = b[i];
+            int32_t l = (int32_t)((uint32_t)a[i] + (uint32_t)(s >> 1) + (uint32_t)(s & 1));
+            a[i] = l;
+            b[i] = (int32_t)((uint32_t)l - (uint32_t)s);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Abre o stream de tokens de um bloco v5 e lê o header do bloco: tipo
+// (TXAC_BLOCK_GROUPS só com TXAC_FLAG_GROUPS), k
+// (TXAC_FLAG_BLOCK_PARAMS), preditor (TXAC_FLAG_PREDICTOR), estágios LMS
+// (TXAC_FLAG_LMS) e modo estéreo (TXAC_FLAG_STEREO, só na esquerda de um par).
+// Campos ausentes assumem os valores fixos do formato. Um TXAC_BLOCK_CONSTANT
+// traz só o valor (int32 LE) e o modo estéreo, e não abre stream nenhum.
+// Devolve o tipo do bloco, ou -1 se o header for inválido.
+static int init_block_stream(Stream4Bit *s, Predictor *pred, uint8_t *payload,
+                             uint32_t bit_size, uint32_t flags) {
+    const int binary = (flags & TXAC_FLAG_BINARY) != 0;
+    size_t avail = bit_size / 8, header = 1;
+    unsigned k = binary ? RESIDUAL_K0 : 1;
+    if (avail < 1) return -1;
+
+    if (payload[0] == TXAC_BLOCK_CONSTANT && (flags & TXAC_FLAG_CONSTANT)) {
+        if (avail < 5) return -1;
+        predictor_fixed(pred, 0);
+        pred->constant = (int32_t)((uint32_t)payload[1] | ((uint32_t)payload[2] << 8) |
+                                   ((uint32_t)payload[3] << 16) | ((uint32_t)payload[4] << 24));
+        if (flags & TXAC_FLAG_STEREO) {
+            if (avail < 6 || payload[5] > STEREO_MID_SIDE) return -1;
+            pred->stereo = payload[5];
+        }
+        return TXAC_BLOCK_CONSTANT;
+    }
+    const int groups = payload[0] == TXAC_BLOCK_GROUPS && (flags & TXAC_FLAG_GROUPS);
+    if (payload[0] != TXAC_BLOCK_TOKENS && !groups) return -1;
+
+    if (flags & TXAC_FLAG_BLOCK_PARAMS) {
+        if (avail < 2) return -1;
+        k = payload[header++];
+        if (k > (binary ? 32u : RICE_MAX_K)) return -1;
+    }
+    if (flags & TXAC_FLAG_PREDICTOR) {
+        int used = predictor_read_header(pred, payload + header, avail - header);
+        if (used < 0 || (pred->wasted && !(flags & TXAC_FLAG_WASTED))) return -1;
+        header += (size_t)used;
+    } else {
+        predictor_fixed(pred, (flags & (1 << 1)) ? 1 : 0);
+    }
+    if (flags & TXAC_FLAG_LMS) {
+        if (avail < header + 1 || payload[header] > LMS_STAGES) return -1;
+        pred->lms_stages = payload[header++];
+    }
+    if (flags & TXAC_FLAG_STEREO) {
+        if (avail < header + 1 || payload[header] > STEREO_MID_SIDE) return -1;
+        pred->stereo = payload[header++];
+    }
+
+    init_stream_bits(s, payload + header, bit_size - header * 8);
+    s->rice_k = k;
+    s->table  = rice_table[binary ? 1 : k];
+    s->groups = groups;
+    return payload[0];
+}
+
 // ============================================================================
 // DESCOMPRESSÃO DIRETA PARA 14-BIT COM DELTA DECODING
 // O acumulador do delta decoding produz int32; o resultado é clampado e
@@ -321,79 +911,231 @@ typedef struct {
     thread_ptr thread;
     volatile int finished;
     int use_delta_encoding;
+    int binary;                       // TXAC_FLAG_BINARY
+    uint32_t flags;                   // flags do header; TXAC_FLAG_STEREO só na esquerda de um par
+    int32_t *residuals;               // v5: resíduos do bloco (block_size valores)
+    unsigned sample_shift;            // TXAC_FLAG_NATIVE: bits_per_sample - 14, senão 0
+    // v5: blocos do canal (compressed_4bit começa em data_base no arquivo)
+    const TXACBlockEntry *blocks;
+    uint32_t block_count;
+    uint32_t block_stride;
+    uint64_t data_base;
 } ChannelLoader;
 
+// Grupo (D)N: dst[i] = dst[i - dist] em ordem crescente, então dist < len
+// repete o trecho, como no LZ77. Sem sobreposição é um memcpy; com dist >= 8
+// cada carga de 8 já está escrita e a cópia vai em AVX2.
+static inline void copy_group(int32_t *dst, uint32_t dist, uint32_t len) {
+    const int32_t *src = dst - dist;
+    if (dist >= len) {
+        memcpy(dst, src, (size_t)len * sizeof(int32_t));
+        return;
+    }
+    uint32_t i = 0;
+    if (dist >= 8)
+        for (; i + 8 <= len; i += 8)
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+    for (; i < len; i++) dst[i] = src[i];
+}
+
+// Âncora de sniper pendente: 'delta' volta a ser aplicado depois que
+// 'remaining' tokens do buraco forem decodificados
+typedef struct {
+    int32_t delta;
+    uint32_t remaining;
+} SniperAnchor;
+
+// Máquina de estados plana no lugar da antiga recursão por elemento do
+// buraco '~' (que parava em profundidade 100 e descartava o resto). As
+// âncoras pendentes ficam numa pilha explícita e o acumulador em variável local.
 void process_stream_to_14bit(ChannelLoader *ldr, Stream4Bit *stream, uint64_t *sample_idx,
-                              int recursion_depth, int32_t *accumulator) {
-    if (recursion_depth > 100) return;
-    
-    // CORREÇÃO: Usamos bit_pos para verificar o fim do stream
-    // Multiplicamos byte_count por 8 para ter o total de bits
-    while (stream->bit_pos < (stream->byte_count * 8)) {
+                              int32_t *accumulator) {
+    Buffer14Bit *buf = ldr->output_buffer;
+    const int use_delta = ldr->use_delta_encoding;
+    int32_t acc = *accumulator;
+    uint64_t produced = 0;
+    uint64_t mean16 = (uint64_t)16 << stream->rice_k;  // estado do modo binário
+
+    SniperAnchor inline_stack[64];
+    SniperAnchor *stack = inline_stack;
+    size_t depth = 0, stack_cap = 64;
+
+    for (;;) {
         ParsedToken token;
-        int token_status = read_token_stream(stream, &token);
-        if (token_status <= 0) break;
+        int token_status = !stream_has_data(stream) ? 0
+                         : ldr->binary ? read_token_binary(stream, &mean16, &token)
+                         : read_token_stream(stream, &token);
 
-        uint32_t rep;
-        int32_t delta_value;
-        
+        if (token_status <= 0) {
+            if (depth == 0) break;
+            // Fim do stream: as âncoras pendentes ainda são emitidas
+            if (!stream_has_data(stream)) {
+                while (depth > 0) {
+                    int32_t d = stack[--depth].delta;
+                    if (use_delta) acc += d; else acc = d;
+                    push_value_14bit(buf, acc);
+                    produced++;
+                }
+                break;
+            }
+            // Token vazio/inválido dentro do buraco conta como elemento
+        }
         // Caso 1: Repetição (valor^repeticoes)
-        if (token.operation == '^') {
-            delta_value = token.value;
-            rep = token.argument;
+        else if (token.operation == '^') {
+            int32_t delta_value = token.value;
+            uint32_t rep = token.argument;
             
-            ensure_buffer_capacity_14bit(ldr->output_buffer, rep);
-            for (uint32_t i = 0; i < rep; i++) {
-                if (ldr->use_delta_encoding) {
-                    *accumulator += delta_value;
-                    pack14(ldr->output_buffer->data, ldr->output_buffer->count++, *accumulator);
-                } else {
-                    pack14(ldr->output_buffer->data, ldr->output_buffer->count++, delta_value);
+            ensure_buffer_capacity_14bit(buf, rep);
+            if (use_delta) {
+                for (uint32_t i = 0; i < rep; i++) {
+                    acc += delta_value;
+                    pack14(buf->data, buf->count++, acc);
+                }
+            } else {
+                for (uint32_t i = 0; i < rep; i++) {
+                    pack14(buf->data, buf->count++, delta_value);
                 }
-                (*sample_idx)++;
             }
-            if (recursion_depth > 0) return;
+            produced += rep;
         }
-        // Caso 2: Sniper/Loop (valor~distancia)
-        else if (token.operation == '~') {
-            delta_value = token.value;
-            rep = token.argument;
-            
-            if (ldr->use_delta_encoding) *accumulator += delta_value;
-            else                         *accumulator  = delta_value;
-            
-            push_value_14bit(ldr->output_buffer, *accumulator);
-            (*sample_idx)++;
-            
-            for (uint32_t i = 0; i < rep; i++) {
-                process_stream_to_14bit(ldr, stream, sample_idx, recursion_depth + 1, accumulator);
+        // Grupos (D)N só existem em blocos v5: no v4 o token é ignorado
+        else if (token.operation == '(') {
+        }
+        // Casos 2 e 3: Sniper (valor~distancia) e valor simples
+        else {
+            int32_t delta_value = token.value;
+            if (use_delta) acc += delta_value; else acc = delta_value;
+            push_value_14bit(buf, acc);
+            produced++;
+
+            if (token.operation == '~') {
+                if (token.argument > 0) {
+                    // O token só termina depois do buraco e da âncora
+                    if (depth == stack_cap) {
+                        size_t new_cap = stack_cap * 2;
+                        SniperAnchor *grown = (SniperAnchor*)malloc(new_cap * sizeof(SniperAnchor));
+                        if (!grown) {
+                            fprintf(stderr, "Error: Insufficient memory (RAM is full)\n");
+                            exit(1);
+                        }
+                        memcpy(grown, stack, depth * sizeof(SniperAnchor));
+                        if (stack != inline_stack) free(stack);
+                        stack = grown;
+                        stack_cap = new_cap;
+                    }
+                    stack[depth].delta = delta_value;
+                    stack[depth].remaining = token.argument;
+                    depth++;
+                    continue;
+                }
+                // Buraco vazio: a âncora vem logo em seguida
+                if (use_delta) acc += delta_value; else acc = delta_value;
+                push_value_14bit(buf, acc);
+                produced++;
             }
-            
-            if (ldr->use_delta_encoding) *accumulator += delta_value;
-            else                         *accumulator  = delta_value;
-            
-            push_value_14bit(ldr->output_buffer, *accumulator);
-            (*sample_idx)++;
-            if (recursion_depth > 0) return;
         }
-        // Caso 3: Valor simples
-        else if (token.operation == '\0') {
-            delta_value = token.value;
-            
-            if (ldr->use_delta_encoding) {
-                if (*sample_idx == 0) *accumulator  = delta_value;
-                else                  *accumulator += delta_value;
-            } else {
-                *accumulator = delta_value;
+
+        // Token completo: conta como um elemento do buraco do topo da pilha;
+        // fechar um sniper completa, por sua vez, um elemento do anterior
+        while (depth > 0 && --stack[depth - 1].remaining == 0) {
+            int32_t d = stack[--depth].delta;
+            if (use_delta) acc += d; else acc = d;
+            push_value_14bit(buf, acc);
+            produced++;
+        }
+    }
+
+    if (stack != inline_stack) free(stack);
+    *accumulator = acc;
+    *sample_idx += produced;
+}
+
+// v5: decodifica os tokens de um bloco como resíduos crus em int32 (sem
+// acumulador nem clamp); o preditor do bloco é aplicado depois, sobre o vetor
+// inteiro. Devolve quantos resíduos foram escritos (no máximo cap).
+static uint32_t decode_residuals(ChannelLoader *ldr, Stream4Bit *stream,
+                                 int32_t *dst, uint32_t cap) {
+    uint32_t count = 0;
+    uint64_t mean16 = (uint64_t)16 << stream->rice_k;  // estado do modo binário
+
+    SniperAnchor inline_stack[64];
+    SniperAnchor *stack = inline_stack;
+    size_t depth = 0, stack_cap = 64;
+
+    for (;;) {
+        ParsedToken token;
+        int token_status = !stream_has_data(stream) ? 0
+                         : ldr->binary ? read_token_binary(stream, &mean16, &token)
+                         : read_token_stream(stream, &token);
+
+        if (token_status <= 0) {
+            if (depth == 0) break;
+            // Fim do stream: as âncoras pendentes ainda são emitidas
+            if (!stream_has_data(stream)) {
+                while (depth > 0) {
+                    int32_t d = stack[--depth].delta;
+                    if (count < cap) dst[count++] = d;
+                }
+                break;
+            }
+            // Token vazio/inválido dentro do buraco conta como elemento
+        }
+        // Caso 1: Repetição (valor^repeticoes)
+        else if (token.operation == '^') {
+            uint32_t rep = token.argument;
+            if (rep > cap - count) rep = cap - count;
+            for (uint32_t i = 0; i < rep; i++) dst[count + i] = token.value;
+            count += rep;
+        }
+        // Caso 4: Grupo (D)N, cópia dos N resíduos que estavam D posições atrás
+        else if (token.operation == '(') {
+            uint32_t dist = (uint32_t)token.value;
+            uint32_t len = token.argument;
+            if (dist >= 1 && dist <= count) {
+                if (len > cap - count) len = cap - count;
+                copy_group(dst + count, dist, len);
+                count += len;
+            }
+        }
+        // Casos 2 e 3: Sniper (valor~distancia) e valor simples
+        else {
+            if (count < cap) dst[count++] = token.value;
+
+            if (token.operation == '~') {
+                if (token.argument > 0) {
+                    if (depth == stack_cap) {
+                        size_t new_cap = stack_cap * 2;
+                        SniperAnchor *grown = (SniperAnchor*)malloc(new_cap * sizeof(SniperAnchor));
+                        if (!grown) {
+                            fprintf(stderr, "Error: Insufficient memory (RAM is full)\n");
+                            exit(1);
+                        }
+                        memcpy(grown, stack, depth * sizeof(SniperAnchor));
+                        if (stack != inline_stack) free(stack);
+                        stack = grown;
+                        stack_cap = new_cap;
+                    }
+                    stack[depth].delta = token.value;
+                    stack[depth].remaining = token.argument;
+                    depth++;
+                    continue;
+                }
+                // Buraco vazio: a âncora vem logo em seguida
+                if (count < cap) dst[count++] = token.value;
             }
-            
-            push_value_14bit(ldr->output_buffer, *accumulator);
-            (*sample_idx)++;
-            if (recursion_depth > 0) return;
+        }
+
+        while (depth > 0 && --stack[depth - 1].remaining == 0) {
+            int32_t d = stack[--depth].delta;
+            if (count < cap) dst[count++] = d;
         }
     }
+
+    if (stack != inline_stack) free(stack);
+    return count;
 }
 
+// Arquivos v4 (sem índice de blocos): o canal inteiro é decodificado na abertura
 void *loader_thread_func(void *arg) {
     ChannelLoader *ldr = (ChannelLoader*)arg;
     uint64_t sample_idx = 0;
@@ -409,7 +1151,7 @@ void *loader_thread_func(void *arg) {
     
     Stream4Bit stream;
     init_stream(&stream, ldr->compressed_4bit, ldr->compressed_size);
-    process_stream_to_14bit(ldr, &stream, &sample_idx, 0, &accumulator);
+    process_stream_to_14bit(ldr, &stream, &sample_idx, &accumulator);
     
     // NÃO há normalização aqui. A conversão para float acontece ao vivo no
     // callback do sokol (audio_cb), sem armazenar os valores em ponto flutuante na RAM.
@@ -420,20 +1162,205 @@ void *loader_thread_func(void *arg) {
     return NULL;
 }
 
+// Bloco TXAC_BLOCK_CONSTANT: silêncio vai de memset, DC em stores AVX2
+static void fill_constant(int32_t *dst, size_t n, int32_t value) {
+    if (value == 0) {
+        memset(dst, 0, n * sizeof(int32_t));
+        return;
+    }
+    const __m256i v = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_si256((__m256i *)(dst + i), v);
+    for (; i < n; i++) dst[i] = value;
+}
+
+// v5: decodifica um bloco em ldr->residuals, que termina com exatamente
+// sample_count amostras int32 (o que faltar vira silêncio). Devolve o modo
+// estéreo do bloco (0 fora de pares).
+unsigned decode_block_int32(ChannelLoader *ldr, const TXACBlockEntry *e) {
+    int32_t *res = ldr->residuals;
+    uint32_t n = 0;
+    unsigned stereo = STEREO_INDEPENDENT;
+
+    // Resíduos primeiro; o preditor precisa das amostras int32 completas,
+    // então o clamp para 14 bits só acontece no final
+    if (e->bit_size >= 8) {
+        uint8_t *payload = ldr->compressed_4bit + (e->byte_offset - ldr->data_base);
+        Stream4Bit stream;
+        Predictor pred;
+        int type = init_block_stream(&stream, &pred, payload, e->bit_size, ldr->flags);
+        if (type == TXAC_BLOCK_CONSTANT) {
+            // Sem tokens, LMS nem preditor: o bloco já é a amostra final
+            fill_constant(res, e->sample_count, pred.constant);
+            n = e->sample_count;
+            stereo = pred.stereo;
+        } else if (type >= 0) {
+            n = decode_residuals(ldr, &stream, res, e->sample_count);
+            if (lms_restore(res, n, pred.lms_stages) < 0) n = 0;
+            restore_prediction(res, n, &pred);
+            restore_wasted(res, n, pred.wasted);
+            stereo = pred.stereo;
+        }
+    }
+    while (n < e->sample_count) res[n++] = 0;
+    return stereo;
+}
+
+// Empacota as n amostras de ldr->residuals no buffer 14-bit do canal
+void pack_block_14bit(ChannelLoader *ldr, uint32_t n) {
+    Buffer14Bit *out = ldr->output_buffer;
+    int32_t *res = ldr->residuals;
+    out->count = 0;
+    ensure_buffer_capacity_14bit(out, n);
+    for (uint32_t i = 0; i < n; i++) pack14(out->data, i, res[i] >> ldr->sample_shift);
+    out->count = n;
+}
+
 // ============================================================================
 // ESTRUTURAS PRINCIPAIS
 // ============================================================================
+#define CHUNK_FRAMES   4096  // quadros por chunk do anel (múltiplo de 8: 8 amostras = 14 bytes)
+#define RING_CHUNKS    32    // ~3 s a 44.1 kHz
+#define PREBUFFER_MS   300   // quanto decodificar antes de liberar o áudio
+#define SEEK_RESERVE   2     // slots que só chunks de um seek novo podem ocupar
+#define BLOCK_CACHE_MB 16    // cache LRU de linhas de blocos já decodificadas
+
+// Linha de blocos decodificada (bloco b de todos os canais), em 14-bit packed
+typedef struct {
+    int64_t      block;      // -1 = slot livre
+    uint64_t     last_used;
+    Buffer14Bit *channels;
+} CachedRow;
+
+// Chunk do anel: quadros intercalados em 14-bit packed, a partir de first_frame.
+// 'epoch' identifica o seek que o gerou; chunks de um epoch antigo são descartados.
+typedef struct {
+    uint8_t *data;
+    uint64_t first_frame;
+    uint32_t frames;
+    uint32_t epoch;
+} PlayChunk;
+
+// Comandos do teclado para o callback (pausa e seek não mexem direto no estado
+// que o callback usa; ele aplica tudo no início do próximo período)
+#define CMD_QUEUE_SIZE 64
+
+typedef enum {
+    CMD_TOGGLE_PAUSE,
+    CMD_SEEK
+} PlayerCommandType;
+
+typedef struct {
+    PlayerCommandType type;
+    uint64_t          frame;             // CMD_SEEK: quadro de destino
+    uint32_t          epoch;             // CMD_SEEK: epoch já publicado para o produtor
+} PlayerCommand;
+
+// Arquivo inteiro mapeado só para leitura: o produtor decodifica direto das
+// páginas do .txac. Pipes, dispositivos e arquivos vazios não mapeiam e
+// continuam no fread.
+typedef struct {
+    uint8_t *data;
+    uint64_t size;
+#if defined(_WIN32)
+    HANDLE   mapping;
+#endif
+} MappedFile;
+
+static int map_file(FILE *f, MappedFile *m) {
+    memset(m, 0, sizeof(*m));
+#if defined(_WIN32)
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+    LARGE_INTEGER size;
+    if (h == INVALID_HANDLE_VALUE || GetFileType(h) != FILE_TYPE_DISK ||
+        !GetFileSizeEx(h, &size) || size.QuadPart <= 0) return 0;
+    m->mapping = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m->mapping) return 0;
+    m->data = (uint8_t*)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m->data) {
+        CloseHandle(m->mapping);
+        m->mapping = NULL;
+        return 0;
+    }
+    m->size = (uint64_t)size.QuadPart;
+#else
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return 0;
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (p == MAP_FAILED) return 0;
+    // A reprodução anda para frente linha a linha; seek só reposiciona
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+    m->data = (uint8_t*)p;
+    m->size = (uint64_t)st.st_size;
+#endif
+    return 1;
+}
+
+static void unmap_file(MappedFile *m) {
+    if (!m->data) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(m->data);
+    CloseHandle(m->mapping);
+#else
+    munmap(m->data, (size_t)m->size);
+#endif
+    memset(m, 0, sizeof(*m));
+}
+
 typedef struct {
     FILE       *file;
+    MappedFile  map;                     // map.data == NULL: linhas lidas com fread
     TXACHeader  header;
-    uint8_t    *pcm_data_14bit;          // Buffer final intercalado em 14-bit packed
+    uint8_t    *pcm_data_14bit;          // v4: faixa inteira intercalada em 14-bit packed
     uint64_t    total_samples;
-    volatile uint64_t playback_cursor;
-    volatile int is_paused;
-    volatile int running;
+    uint64_t    total_frames;
+    // Telemetria: escrita pelo callback com stores atômicos, lida pela thread de UI
+    uint64_t    playback_cursor;         // em amostras intercaladas
+    int         is_paused;
+    int         running;
     ChannelLoader loaders[MAX_CHANNELS];
-    Buffer14Bit   channel_buffers[MAX_CHANNELS];
+    Buffer14Bit   channel_buffers[MAX_CHANNELS];  // v4: canais antes da intercalação
     float         conversion_factor;     // Pré-calculado uma vez; usado no callback
+
+    // v5: índice de blocos; os dados comprimidos são lidos do arquivo por linha de blocos
+    TXACBlockEntry *blocks;
+    uint32_t    block_count;
+    uint32_t    block_size;
+    uint8_t    *row_buf;
+    size_t      row_cap;
+    int32_t    *residuals;               // resíduos da linha em decodificação (block_size por canal)
+    uint32_t    pair_mask;               // pares acoplados: bit i = canais i e i+1
+
+    // Cache LRU de linhas decodificadas (só o produtor mexe): seek para perto
+    // de onde já se tocou não precisa decodificar de novo
+    CachedRow  *cache;
+    uint32_t    cache_rows;
+    int32_t    *cache_slot;              // bloco → índice em cache, ou -1
+    uint64_t    cache_tick;
+    CachedRow  *cur_row;
+    volatile uint32_t cache_hits;
+    volatile uint32_t cache_misses;
+
+    // Anel SPSC: o produtor só escreve ring_head, o callback só escreve ring_tail
+    PlayChunk   ring[RING_CHUNKS];
+    uint32_t    ring_head;
+    uint32_t    ring_tail;
+    uint32_t    chunk_pos;               // quadros já tocados do chunk em ring_tail
+    uint32_t    seek_epoch;              // teclado → produtor
+    uint64_t    seek_frame;
+    uint32_t    play_epoch;              // epoch que o callback está tocando (só ele escreve)
+    uint32_t    underruns;
+    uint64_t    cb_last_ns;              // duração do último callback
+    uint64_t    cb_peak_ns;              // pior duração desde a última leitura da UI
+
+    // Fila de comandos SPSC: a thread do teclado escreve cmd_head, o callback cmd_tail
+    PlayerCommand cmd_queue[CMD_QUEUE_SIZE];
+    uint32_t    cmd_head;
+    uint32_t    cmd_tail;
+    int         ui_running;
+    thread_ptr  ui_thread;
+    int         stop_producer;
+    thread_ptr  producer;
 } txacplay_desc;
 
 // ============================================================================
@@ -473,52 +1400,359 @@ void intercalar_canais_14bit(txacplay_desc *tp) {
     printf("Ready: %.2f MB of RAM for audio (14-bit packed, ~56%% less than float).\n", size_mb);
 }
 
+// ============================================================================
+// PRODUTOR — DECODIFICAÇÃO À FRENTE NUM ANEL SPSC
+// Uma thread decodifica bloco a bloco e publica chunks prontos para o callback.
+// Sem locks: o produtor publica ring_head com release, o callback avança
+// ring_tail com release, e cada lado lê o índice do outro com acquire.
+// ============================================================================
+
+// Devolve a linha de blocos b decodificada. Na falta, lê do arquivo só os
+// bytes da linha (dados em ordem de quadro: o bloco b de todos os canais é
+// contíguo), decodifica cada canal e guarda no lugar da linha menos usada.
+CachedRow *get_block_row(txacplay_desc *tp, uint32_t b) {
+    int ch = tp->header.channels;
+
+    int32_t slot = tp->cache_slot[b];
+    if (slot >= 0) {
+        tp->cache[slot].last_used = ++tp->cache_tick;
+        tp->cache_hits++;
+        return &tp->cache[slot];
+    }
+    tp->cache_misses++;
+
+    CachedRow *victim = &tp->cache[0];
+    for (uint32_t i = 1; i < tp->cache_rows && victim->block >= 0; i++) {
+        if (tp->cache[i].block < 0 || tp->cache[i].last_used < victim->last_used)
+            victim = &tp->cache[i];
+    }
+    if (victim->block >= 0) tp->cache_slot[victim->block] = -1;
+
+    const TXACBlockEntry *row = &tp->blocks[(size_t)b * ch];
+    uint64_t start = UINT64_MAX, end = 0;
+
+    for (int c = 0; c < ch; c++) {
+        uint64_t bytes = (row[c].bit_size + 7) / 8;
+        if (bytes == 0) continue;
+        if (row[c].byte_offset < start) start = row[c].byte_offset;
+        if (row[c].byte_offset + bytes > end) end = row[c].byte_offset + bytes;
+    }
+
+    uint8_t *row_data = tp->row_buf;
+    if (end > start && tp->map.data && end <= tp->map.size) {
+        row_data = tp->map.data + start;
+    } else if (end > start) {
+        size_t need = (size_t)(end - start);
+        if (need > tp->row_cap) {
+            uint8_t *grown = (uint8_t*)realloc(tp->row_buf, need);
+            if (!grown) {
+                fprintf(stderr, "Error: Insufficient memory (RAM is full)\n");
+                exit(1);
+            }
+            tp->row_buf = grown;
+            tp->row_cap = need;
+        }
+        fseek(tp->file, (long)start, SEEK_SET);
+        if (fread(tp->row_buf, 1, need, tp->file) != need)
+            memset(tp->row_buf, 0, need);  // arquivo truncado: o bloco vira silêncio
+        row_data = tp->row_buf;
+    }
+
+    // Todos os canais terminam com os quadros da linha, mesmo com tabela incompleta
+    uint64_t row_frames = tp->total_frames - (uint64_t)b * tp->block_size;
+    if (row_frames > tp->block_size) row_frames = tp->block_size;
+
+    // Linha inteira em int32 primeiro: pares acoplados precisam dos dois
+    // canais para desfazer o modo estéreo antes do clamp para 14 bits
+    unsigned stereo[MAX_CHANNELS];
+    for (int c = 0; c < ch; c++) {
+        tp->loaders[c].compressed_4bit = row_data;
+        tp->loaders[c].data_base       = start;
+        stereo[c] = decode_block_int32(&tp->loaders[c], &row[c]);
+    }
+    for (int c = 0; c + 1 < ch; c++) {
+        if (!(tp->pair_mask & (1u << c))) continue;
+        stereo_undo(tp->loaders[c].residuals, tp->loaders[c + 1].residuals,
+                    row[c].sample_count < row[c + 1].sample_count
+                    ? row[c].sample_count : row[c + 1].sample_count, stereo[c]);
+    }
+
+    for (int c = 0; c < ch; c++) {
+        Buffer14Bit *out = &victim->channels[c];
+        tp->loaders[c].output_buffer = out;
+        pack_block_14bit(&tp->loaders[c], row[c].sample_count);
+
+        if (out->count > row_frames) out->count = row_frames;
+        ensure_buffer_capacity_14bit(out, row_frames - out->count);
+        while (out->count < row_frames) pack14(out->data, out->count++, 0);
+    }
+
+    victim->block     = b;
+    victim->last_used = ++tp->cache_tick;
+    tp->cache_slot[b] = (int32_t)(victim - tp->cache);
+    return victim;
+}
+
+// Preenche o chunk a partir de 'frame' com até CHUNK_FRAMES quadros; só
+// para antes no fim da faixa (o produtor volta ao início)
+void fill_chunk(txacplay_desc *tp, PlayChunk *ck, uint64_t frame) {
+    int ch = tp->header.channels;
+    uint64_t left;
+    uint64_t k = 0;
+
+    if (tp->blocks) {
+        // Junta linhas seguidas até CHUNK_FRAMES: com --block pequeno um chunk
+        // por bloco deixaria o anel com poucos quadros e o callback em underrun
+        left = tp->total_frames - frame;
+        if (left > CHUNK_FRAMES) left = CHUNK_FRAMES;
+
+        uint64_t pos = frame, end = frame + left;
+        while (pos < end) {
+            uint32_t b = (uint32_t)(pos / tp->block_size);
+            if (!tp->cur_row || tp->cur_row->block != (int64_t)b)
+                tp->cur_row = get_block_row(tp, b);
+            const Buffer14Bit *src = tp->cur_row->channels;
+
+            uint64_t local = pos - (uint64_t)b * tp->block_size;
+            uint64_t n = src[0].count > local ? src[0].count - local : 0;
+            if (n > end - pos) n = end - pos;
+            if (n == 0) break;  // linha vazia: não deveria acontecer, a linha cobre o bloco
+
+            for (uint64_t f = local; f < local + n; f++)
+                for (int c = 0; c < ch; c++)
+                    pack14(ck->data, k++, unpack14(src[c].data, f));
+            pos += n;
+        }
+        left = pos - frame;
+    } else {
+        left = tp->total_frames - frame;
+        if (left > CHUNK_FRAMES) left = CHUNK_FRAMES;
+
+        uint64_t base = frame * ch;
+        for (; k < left * ch; k++)
+            pack14(ck->data, k, unpack14(tp->pcm_data_14bit, base + k));
+    }
+
+    ck->first_frame = frame;
+    ck->frames      = (uint32_t)left;
+}
+
+void *producer_thread_func(void *arg) {
+    txacplay_desc *tp = (txacplay_desc*)arg;
+    uint32_t epoch = __atomic_load_n(&tp->seek_epoch, __ATOMIC_ACQUIRE);
+    uint64_t frame = 0;
+    uint32_t fresh = SEEK_RESERVE;  // chunks publicados desde o último seek
+
+    while (!__atomic_load_n(&tp->stop_producer, __ATOMIC_ACQUIRE)) {
+        uint32_t e = __atomic_load_n(&tp->seek_epoch, __ATOMIC_ACQUIRE);
+        if (e != epoch) {
+            epoch = e;
+            frame = __atomic_load_n(&tp->seek_frame, __ATOMIC_RELAXED);
+            fresh = 0;
+        }
+
+        // Em regime normal o anel para SEEK_RESERVE slots antes de encher; logo
+        // depois de um seek esses slots recebem o áudio novo na hora, sem
+        // esperar o callback descartar os chunks antigos
+        uint32_t head  = tp->ring_head;
+        uint32_t used  = head - __atomic_load_n(&tp->ring_tail, __ATOMIC_ACQUIRE);
+        uint32_t limit = fresh < SEEK_RESERVE ? RING_CHUNKS : RING_CHUNKS - SEEK_RESERVE;
+        if (used >= limit || tp->total_frames == 0) {
+            THREAD_SLEEP_MS(1);  // anel cheio: o callback ainda tem áudio de sobra
+            continue;
+        }
+
+        // Fim da faixa: volta ao início (mesmo comportamento de loop de antes)
+        if (frame >= tp->total_frames) frame = 0;
+
+        PlayChunk *ck = &tp->ring[head % RING_CHUNKS];
+        fill_chunk(tp, ck, frame);
+        ck->epoch = epoch;
+        __atomic_store_n(&tp->ring_head, head + 1, __ATOMIC_RELEASE);
+        frame += ck->frames;
+        if (fresh < SEEK_RESERVE) fresh++;
+    }
+    return NULL;
+}
+
 // ============================================================================
 // CÁLCULO DE TEMPO
 // ============================================================================
 double calculate_time(txacplay_desc *tp) {
-    return (double)tp->playback_cursor / (double)(tp->header.sample_rate * tp->header.channels);
+    return (double)__atomic_load_n(&tp->playback_cursor, __ATOMIC_RELAXED) /
+           (double)(tp->header.sample_rate * tp->header.channels);
 }
 
 double calculate_duration(txacplay_desc *tp) {
     return (double)tp->total_samples / (double)(tp->header.sample_rate * tp->header.channels);
 }
 
+// Relógio monotônico sem syscall (vDSO no Linux, QPC no Windows): seguro no callback
+static double now_seconds(void) {
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// ============================================================================
+// CONVERSÃO EM LOTE 14-BIT → FLOAT
+// A cada 8 amostras o bitstream volta a ficar alinhado em byte (8 × 14 bits =
+// 14 bytes), então um grupo de 8 sempre tem o mesmo layout: a amostra j começa
+// no byte (14j)/8, bit (14j)%8. O AVX2 copia os 3 bytes de cada amostra para
+// uma lane de 32 bits (pshufb), alinha com shift variável, faz o sign-extend
+// com shift aritmético e converte para float, tudo em registrador.
+// ============================================================================
+static void unpack14_to_float_scalar(const uint8_t *src, uint64_t idx, float *dst,
+                                     uint64_t n, float cf) {
+    for (uint64_t i = 0; i < n; i++)
+        dst[i] = (float)unpack14(src, idx + i) * cf;
+}
+
+static void unpack14_to_float(const uint8_t *src, uint64_t idx, float *dst,
+                              uint64_t n, float cf) {
+    // Cabeça escalar até o próximo grupo de 8 alinhado
+    while (n > 0 && (idx & 7)) {
+        *dst++ = (float)unpack14(src, idx++) * cf;
+        n--;
+    }
+
+    const __m256i shuf = _mm256_setr_epi8(
+        0, 1, 2, -1,   1, 2, 3, -1,   3, 4, 5, -1,   5, 6, 7, -1,
+        7, 8, 9, -1,   8, 9, 10, -1,  10, 11, 12, -1, 12, 13, 14, -1);
+    // (x << (18 - bit_off)) >> 18 (aritmético) = 14 bits com sinal
+    const __m256i lshift = _mm256_setr_epi32(18, 12, 14, 16, 18, 12, 14, 16);
+    const __m256  scale  = _mm256_set1_ps(cf);
+
+    const uint8_t *p = src + (idx / 8) * 14;
+    // O load de 16 bytes lê 2 além do grupo: os buffers têm +4 bytes de margem
+    while (n >= 8) {
+        __m128i raw = _mm_loadu_si128((const __m128i*)p);
+        __m256i v   = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(raw), shuf);
+        v = _mm256_srai_epi32(_mm256_sllv_epi32(v, lshift), 18);
+        _mm256_storeu_ps(dst, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+        p   += 14;
+        dst += 8;
+        idx += 8;
+        n   -= 8;
+    }
+
+    for (uint64_t i = 0; i < n; i++)
+        dst[i] = (float)unpack14(src, idx + i) * cf;
+}
+
 // ============================================================================
-// CALLBACK SOKOL — CONVERSÃO 14-BIT → FLOAT AO VIVO
-// Nenhum float é armazenado na RAM; a conversão acontece amostra a amostra
-// enquanto o sokol consome o buffer de saída.
+// CALLBACK MINIAUDIO — CONVERSÃO 14-BIT → FLOAT AO VIVO
+// Nenhum float é armazenado na RAM; a conversão acontece em lotes de 8 amostras
+// enquanto o callback consome os chunks do anel. O fim do chunk (e o loop da
+// faixa, resolvido no produtor) fica fora do laço interno. Se o produtor não acompanhar,
+// o resto do buffer sai em silêncio (underrun) em vez de bloquear.
+// Tempo real: sem alocação, sem lock, sem printf. Comandos chegam pela fila
+// SPSC e o status sai por atômicos que a thread de UI imprime.
 // ============================================================================
+
+// Aplica os comandos pendentes do teclado (só o callback chama)
+static void apply_commands(txacplay_desc *tp) {
+    uint32_t tail = tp->cmd_tail;
+    uint32_t head = __atomic_load_n(&tp->cmd_head, __ATOMIC_ACQUIRE);
+
+    for (; tail != head; tail++) {
+        const PlayerCommand *cmd = &tp->cmd_queue[tail % CMD_QUEUE_SIZE];
+        if (cmd->type == CMD_TOGGLE_PAUSE) {
+            __atomic_store_n(&tp->is_paused, !tp->is_paused, __ATOMIC_RELAXED);
+        } else if (cmd->type == CMD_SEEK) {
+            // O produtor já recomeçou no destino; daqui em diante chunks de
+            // epochs anteriores são descartados
+            if ((int32_t)(cmd->epoch - tp->play_epoch) > 0) tp->play_epoch = cmd->epoch;
+            __atomic_store_n(&tp->playback_cursor, cmd->frame * tp->header.channels,
+                             __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&tp->cmd_tail, tail, __ATOMIC_RELEASE);
+}
+
 void audio_cb(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
     txacplay_desc *tp = (txacplay_desc*)pDevice->pUserData;
     float *buffer = (float*)pOutput;
     int num_channels = pDevice->playback.channels;
+    int num_frames = (int)frameCount;
+    (void)pInput;
     
-    if (tp->is_paused || !tp->running || !tp->pcm_data_14bit) {
-        memset(buffer, 0, frameCount * num_channels * sizeof(float));
+    double t_start = now_seconds();
+    apply_commands(tp);
+
+    if (tp->is_paused || !__atomic_load_n(&tp->running, __ATOMIC_ACQUIRE)) {
+        memset(buffer, 0, num_frames * num_channels * sizeof(float));
         return;
     }
     
-    int total_samples = frameCount * num_channels;
-    float cf = tp->conversion_factor;
+    float    cf    = tp->conversion_factor;  // fator pré-calculado: pow(10, dB/20) / 2^31
+    int      done  = 0;
     
-    for (int i = 0; i < total_samples; i++) {
-        if (tp->playback_cursor >= tp->total_samples) tp->playback_cursor = 0;
+    while (done < num_frames) {
+        uint32_t tail = tp->ring_tail;
+        if (tail == __atomic_load_n(&tp->ring_head, __ATOMIC_ACQUIRE)) {
+            memset(buffer + (size_t)done * num_channels, 0,
+                   (size_t)(num_frames - done) * num_channels * sizeof(float));
+            __atomic_fetch_add(&tp->underruns, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        PlayChunk *ck = &tp->ring[tail % RING_CHUNKS];
+        int32_t age = (int32_t)(ck->epoch - tp->play_epoch);
+        if (age < 0) {
+            // Decodificado antes do último seek: descarta sem tocar
+            tp->chunk_pos = 0;
+            __atomic_store_n(&tp->ring_tail, tail + 1, __ATOMIC_RELEASE);
+            continue;
+        }
+        if (age > 0) tp->play_epoch = ck->epoch;  // seek chegou antes do comando
+
+        uint32_t n = ck->frames - tp->chunk_pos;
+        if (n > (uint32_t)(num_frames - done)) n = (uint32_t)(num_frames - done);
 
-        // Conversão 14-bit -> float ao vivo
-        buffer[i] = (float)unpack14(tp->pcm_data_14bit, tp->playback_cursor++) * cf;
+        // Multiplicação por cf: normaliza para -1.0..1.0 com amplificação DB
+        unpack14_to_float(ck->data, (uint64_t)tp->chunk_pos * num_channels,
+                          buffer + (size_t)done * num_channels,
+                          (uint64_t)n * num_channels, cf);
+
+        done          += n;
+        tp->chunk_pos += n;
+        __atomic_store_n(&tp->playback_cursor,
+                         (ck->first_frame + tp->chunk_pos) * num_channels, __ATOMIC_RELAXED);
+        if (tp->chunk_pos == ck->frames) {
+            tp->chunk_pos = 0;
+            __atomic_store_n(&tp->ring_tail, tail + 1, __ATOMIC_RELEASE);
+        }
     }
-    printf("\r%.2f / %.2f sec", calculate_time(tp), calculate_duration(tp));
-    fflush(stdout);
+
+    uint64_t dt = (uint64_t)((now_seconds() - t_start) * 1e9);
+    __atomic_store_n(&tp->cb_last_ns, dt, __ATOMIC_RELAXED);
+    if (dt > __atomic_load_n(&tp->cb_peak_ns, __ATOMIC_RELAXED))
+        __atomic_store_n(&tp->cb_peak_ns, dt, __ATOMIC_RELAXED);
+}
+
+// Enfileira um comando para o callback; com a fila cheia o comando é descartado
+int post_command(txacplay_desc *tp, PlayerCommandType type, uint64_t frame, uint32_t epoch) {
+    uint32_t head = tp->cmd_head;
+    if (head - __atomic_load_n(&tp->cmd_tail, __ATOMIC_ACQUIRE) >= CMD_QUEUE_SIZE)
+        return 0;
+    tp->cmd_queue[head % CMD_QUEUE_SIZE].type  = type;
+    tp->cmd_queue[head % CMD_QUEUE_SIZE].frame = frame;
+    tp->cmd_queue[head % CMD_QUEUE_SIZE].epoch = epoch;
+    __atomic_store_n(&tp->cmd_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
 }
 
 void toggle_pause(txacplay_desc *tp) {
-    tp->is_paused = !tp->is_paused;
-    if (tp->is_paused) {
-        printf("\nPAUSED\n");
-    } else {
-        printf("\nPLAYING\n");
-    }
+    post_command(tp, CMD_TOGGLE_PAUSE, 0, 0);
 }
 
 void txacplay_seek_absolute(txacplay_desc *tp, double time_seconds) {
@@ -532,12 +1766,38 @@ void txacplay_seek_absolute(txacplay_desc *tp, double time_seconds) {
         target_samples = tp->total_samples - (tp->total_samples % tp->header.channels);
     if (time_seconds < 0) target_samples = 0;
     
-    tp->playback_cursor = target_samples;
+    // O produtor é avisado direto para já decodificar o destino; o callback
+    // troca de epoch quando o comando (ou o primeiro chunk novo) chegar
+    uint64_t frame = target_samples / tp->header.channels;
+    __atomic_store_n(&tp->seek_frame, frame, __ATOMIC_RELAXED);
+    uint32_t epoch = __atomic_add_fetch(&tp->seek_epoch, 1, __ATOMIC_RELEASE);
+    post_command(tp, CMD_SEEK, frame, epoch);
 }
 
-void update_timer(txacplay_desc *tp) {
-    printf("\r%.2f / %.2f sec", calculate_time(tp), calculate_duration(tp));
-    fflush(stdout);
+// ============================================================================
+// THREAD DE UI — imprime o status publicado pelo callback
+// ============================================================================
+void *ui_thread_func(void *arg) {
+    txacplay_desc *tp = (txacplay_desc*)arg;
+    int shown_paused = 0;
+
+    while (__atomic_load_n(&tp->ui_running, __ATOMIC_ACQUIRE)) {
+        int paused = __atomic_load_n(&tp->is_paused, __ATOMIC_RELAXED);
+        if (paused != shown_paused) {
+            printf(paused ? "\nPAUSED\n" : "\nPLAYING\n");
+            shown_paused = paused;
+        }
+
+        uint64_t peak = __atomic_exchange_n(&tp->cb_peak_ns, 0, __ATOMIC_RELAXED);
+        printf("\r%.2f / %.2f sec | callback %.0f us (peak %.0f us) | underruns %u   ",
+               calculate_time(tp), calculate_duration(tp),
+               (double)__atomic_load_n(&tp->cb_last_ns, __ATOMIC_RELAXED) / 1000.0,
+               (double)peak / 1000.0,
+               __atomic_load_n(&tp->underruns, __ATOMIC_RELAXED));
+        fflush(stdout);
+        THREAD_SLEEP_MS(100);
+    }
+    return NULL;
 }
 
 // ============================================================================
@@ -549,6 +1809,8 @@ txacplay_desc *txacplay_open(const char *path) {
     
     txacplay_desc *tp = (txacplay_desc*)calloc(1, sizeof(txacplay_desc));
     tp->file = f;
+    map_file(f, &tp->map);
+    init_rice_table();
     
     char     magic[4]; fread(magic, 1, 4, f);
     uint32_t version;  fread(&version, 4, 1, f);
@@ -557,72 +1819,334 @@ txacplay_desc *txacplay_open(const char *path) {
     fread(&tp->header.bits_per_sample,2, 1, f);
     fread(&tp->header.flags,          4, 1, f);
     fread(&tp->header.total_samples,  8, 1, f);
-    fseek(f, 36, SEEK_CUR);
+
+    // v5: a área reservada guarda o descritor da tabela de blocos
+    uint32_t block_size = 0, block_count = 0;
+    uint64_t table_offset = 0;
+    if (version >= 5) {
+        fread(&block_size,   4, 1, f);
+        fread(&block_count,  4, 1, f);
+        fread(&table_offset, 8, 1, f);
+        fread(&tp->pair_mask, 4, 1, f);
+        fseek(f, 16, SEEK_CUR);
+    } else {
+        fseek(f, 36, SEEK_CUR);
+    }
+    if (version > 5 || tp->header.channels == 0 || tp->header.channels > MAX_CHANNELS) {
+        printf("Unsupported TXAC file (version %u, %u channels)\n", version, tp->header.channels);
+        unmap_file(&tp->map);
+        fclose(f);
+        free(tp);
+        return NULL;
+    }
+
+    // Só pares dentro do arquivo e sem canal repetido valem
+    if (!(tp->header.flags & TXAC_FLAG_STEREO)) tp->pair_mask = 0;
+    if (tp->header.channels < 32) tp->pair_mask &= (1u << (tp->header.channels - 1)) - 1;
+    if (tp->pair_mask & (tp->pair_mask << 1)) {
+        printf("Invalid TXAC channel pair mask\n");
+        unmap_file(&tp->map);
+        fclose(f);
+        free(tp);
+        return NULL;
+    }
     
     int use_delta = (tp->header.flags & (1 << 1)) != 0;
+    int binary    = (tp->header.flags & TXAC_FLAG_BINARY) != 0;
+    int native    = (tp->header.flags & TXAC_FLAG_NATIVE) != 0;
+    if (native && tp->header.bits_per_sample != 16 && tp->header.bits_per_sample != 24 &&
+        tp->header.bits_per_sample != 32) {
+        printf("Unsupported native bit depth (%u)\n", tp->header.bits_per_sample);
+        unmap_file(&tp->map);
+        fclose(f);
+        free(tp);
+        return NULL;
+    }
     
     printf("TXAC version: %u\n", version);
     printf("Delta encoding: %s\n", use_delta ? "YES" : "NO");
+    int block_k   = (tp->header.flags & TXAC_FLAG_BLOCK_PARAMS) != 0;
+    printf("Residual coding: %s\n", binary ? "binary (adaptive Rice)"
+                                           : block_k ? "text (Rice, k per block)" : "text (Rice k=1)");
     printf("Sample rate: %u Hz\n", tp->header.sample_rate);
     printf("Channels: %u\n", tp->header.channels);
     printf("Bits per sample: %u\n", tp->header.bits_per_sample);
     
     // Fator de conversão pré-calculado: usado no callback para 14-bit → float
-    // Mantém a mesma semântica do encoder (amplificação de DB_AMPLIFICATION dB)
-    tp->conversion_factor = (float)(pow(10.0, DB_AMPLIFICATION / 20.0) / 2147483648.0);
+    // Mantém a mesma semântica do encoder (amplificação de DB_AMPLIFICATION dB);
+    // no modo nativo o bloco já foi deslocado para 14 bits em fundo de escala
+    tp->conversion_factor = native ? 1.0f / 8192.0f
+                                   : (float)(pow(10.0, DB_AMPLIFICATION / 20.0) / 2147483648.0);
     
     uint64_t offsets[MAX_CHANNELS], sizes[MAX_CHANNELS];
-    for (int i = 0; i < tp->header.channels; i++) {
-        fread(&offsets[i], 8, 1, f);
-        fread(&sizes[i],   8, 1, f);
+    TXACBlockEntry *blocks = NULL;
+    uint64_t data_base = 64;
+
+    if (version >= 5) {
+        uint64_t expected = block_size ? (tp->header.total_samples + block_size - 1) / block_size : 0;
+        if (block_size == 0 || block_count != expected || table_offset < data_base) {
+            printf("Invalid block table descriptor\n");
+            unmap_file(&tp->map);
+            fclose(f);
+            free(tp);
+            return NULL;
+        }
+
+        size_t entries = (size_t)block_count * tp->header.channels;
+        blocks = (TXACBlockEntry*)calloc(entries + 1, sizeof(TXACBlockEntry));
+        if (!blocks) {
+            fprintf(stderr, "Error: Failed to allocate RAM for block table\n");
+            exit(1);
+        }
+
+        fseek(f, table_offset, SEEK_SET);
+        for (size_t i = 0; i < entries; i++) {
+            TXACBlockEntry *e = &blocks[i];
+            fread(&e->sample_index, 8, 1, f);
+            fread(&e->byte_offset,  8, 1, f);
+            fread(&e->bit_size,     4, 1, f);
+            fread(&e->sample_count, 4, 1, f);
+
+            if (e->byte_offset < data_base ||
+                e->byte_offset + (e->bit_size + 7) / 8 > table_offset ||
+                e->sample_count > block_size ||
+                e->sample_index != (uint64_t)(i / tp->header.channels) * block_size ||
+                e->sample_index + e->sample_count > tp->header.total_samples) {
+                printf("Corrupt block table entry %zu\n", i);
+                unmap_file(&tp->map);
+                fclose(f);
+                free(blocks);
+                free(tp);
+                return NULL;
+            }
+        }
+        printf("Blocks: %u x %u samples\n", block_count, block_size);
+    } else {
+        for (int i = 0; i < tp->header.channels; i++) {
+            fread(&offsets[i], 8, 1, f);
+            fread(&sizes[i],   8, 1, f);
+        }
     }
     
-    // Inicia threads que fazem parsing direto 4bit → 14bit
     for (int i = 0; i < tp->header.channels; i++) {
-        init_buffer_14bit(&tp->channel_buffers[i],
-                          tp->header.total_samples);
-        
-        tp->loaders[i].channel_id        = i;
-        tp->loaders[i].output_buffer     = &tp->channel_buffers[i];
-        tp->loaders[i].compressed_size   = sizes[i];
+        tp->loaders[i].channel_id         = i;
+        tp->loaders[i].output_buffer      = &tp->channel_buffers[i];
         tp->loaders[i].use_delta_encoding = use_delta;
-        
-        tp->loaders[i].compressed_4bit = malloc(sizes[i]);
-        fseek(f, offsets[i], SEEK_SET);
-        fread(tp->loaders[i].compressed_4bit, 1, sizes[i], f);
-        
-        CREATE_THREAD(&tp->loaders[i].thread, loader_thread_func, &tp->loaders[i]);
+        tp->loaders[i].binary             = binary;
+        tp->loaders[i].flags              = tp->header.flags;
+        tp->loaders[i].sample_shift       = native ? tp->header.bits_per_sample - 14u : 0;
+        if (!(tp->pair_mask & (1u << i)))
+            tp->loaders[i].flags &= ~(uint32_t)TXAC_FLAG_STEREO;
     }
-    
-    for (int i = 0; i < tp->header.channels; i++) {
-        JOIN_THREAD(tp->loaders[i].thread);
-        free(tp->loaders[i].compressed_4bit);
+
+    if (blocks) {
+        // v5: nada é decodificado aqui; o produtor lê e decodifica bloco a bloco
+        tp->blocks       = blocks;
+        tp->block_count  = block_count;
+        tp->block_size   = block_size;
+        tp->total_frames = tp->header.total_samples;
+        tp->total_samples = tp->total_frames * tp->header.channels;
+        tp->residuals    = (int32_t*)malloc((size_t)block_size * tp->header.channels * sizeof(int32_t));
+        if (!tp->residuals) {
+            fprintf(stderr, "Error: Failed to allocate RAM for block decoder\n");
+            exit(1);
+        }
+        for (int i = 0; i < tp->header.channels; i++)
+            tp->loaders[i].residuals = tp->residuals + (size_t)i * block_size;
+
+        // Quantas linhas cabem em BLOCK_CACHE_MB (no mínimo 4)
+        uint64_t row_bytes = (bytes_for_14bit(block_size + 1) + 4) * tp->header.channels;
+        uint64_t rows = ((uint64_t)BLOCK_CACHE_MB << 20) / row_bytes;
+        if (rows < 4) rows = 4;
+        if (rows > block_count) rows = block_count ? block_count : 1;
+        tp->cache_rows = (uint32_t)rows;
+        tp->cache      = (CachedRow*)calloc(rows, sizeof(CachedRow));
+        tp->cache_slot = (int32_t*)malloc(((size_t)block_count + 1) * sizeof(int32_t));
+        if (!tp->cache || !tp->cache_slot) {
+            fprintf(stderr, "Error: Failed to allocate RAM for block cache\n");
+            exit(1);
+        }
+        for (uint32_t b = 0; b <= block_count; b++) tp->cache_slot[b] = -1;
+        for (uint64_t r = 0; r < rows; r++) {
+            tp->cache[r].block    = -1;
+            tp->cache[r].channels = (Buffer14Bit*)calloc(tp->header.channels, sizeof(Buffer14Bit));
+            if (!tp->cache[r].channels) {
+                fprintf(stderr, "Error: Failed to allocate RAM for block cache\n");
+                exit(1);
+            }
+            for (int i = 0; i < tp->header.channels; i++)
+                init_buffer_14bit(&tp->cache[r].channels[i], block_size + 1);
+        }
+        printf("Block cache: %u rows (%.2f MB)\n", tp->cache_rows,
+               (double)(rows * row_bytes) / (1024.0 * 1024.0));
+    } else {
+        // v4: sem pontos de reinício, a faixa inteira é decodificada antes de tocar
+        int copied[MAX_CHANNELS];   // canal lido com fread (arquivo não mapeado ou truncado)
+        for (int i = 0; i < tp->header.channels; i++) {
+            init_buffer_14bit(&tp->channel_buffers[i], tp->header.total_samples);
+            tp->loaders[i].compressed_size = sizes[i];
+            copied[i] = !(tp->map.data && offsets[i] <= tp->map.size && sizes[i] <= tp->map.size - offsets[i]);
+            if (!copied[i]) {
+                tp->loaders[i].compressed_4bit = tp->map.data + offsets[i];
+            } else {
+                tp->loaders[i].compressed_4bit = malloc(sizes[i]);
+                fseek(f, offsets[i], SEEK_SET);
+                fread(tp->loaders[i].compressed_4bit, 1, sizes[i], f);
+            }
+            CREATE_THREAD(&tp->loaders[i].thread, loader_thread_func, &tp->loaders[i]);
+        }
+        for (int i = 0; i < tp->header.channels; i++) {
+            JOIN_THREAD(tp->loaders[i].thread);
+            if (copied[i]) free(tp->loaders[i].compressed_4bit);
+        }
+
+        intercalar_canais_14bit(tp);
+        tp->total_frames = tp->total_samples / tp->header.channels;
+
+        // Libera os buffers por canal; só o buffer intercalado fica na RAM
+        for (int i = 0; i < tp->header.channels; i++) {
+            free(tp->channel_buffers[i].data);
+            tp->channel_buffers[i].data = NULL;
+        }
     }
-    
-    intercalar_canais_14bit(tp);
-    
-    // Libera os buffers por canal; só o buffer intercalado fica na RAM
-    for (int i = 0; i < tp->header.channels; i++) {
-        free(tp->channel_buffers[i].data);
+
+    // Anel de chunks: tamanho fixo, não depende da duração da faixa
+    uint64_t chunk_bytes = bytes_for_14bit((uint64_t)CHUNK_FRAMES * tp->header.channels) + 4;
+    for (int i = 0; i < RING_CHUNKS; i++) {
+        tp->ring[i].data = (uint8_t*)calloc(chunk_bytes, 1);
+        if (!tp->ring[i].data) {
+            fprintf(stderr, "Error: Failed to allocate RAM for playback ring\n");
+            exit(1);
+        }
     }
+
+    CREATE_THREAD(&tp->producer, producer_thread_func, tp);
+
+    // Só libera o áudio quando houver PREBUFFER_MS decodificados (ou o anel encher)
+    uint64_t want = (uint64_t)tp->header.sample_rate * PREBUFFER_MS / 1000;
+    uint32_t want_chunks = (uint32_t)((want + CHUNK_FRAMES - 1) / CHUNK_FRAMES);
+    if (want_chunks < 1) want_chunks = 1;
+    if (want_chunks > RING_CHUNKS - SEEK_RESERVE) want_chunks = RING_CHUNKS - SEEK_RESERVE;
+    while (tp->total_frames > 0 &&
+           __atomic_load_n(&tp->ring_head, __ATOMIC_ACQUIRE) < want_chunks)
+        THREAD_SLEEP_MS(1);
+
+    printf("Ring: %d x %d frames (%.2f MB)\n", RING_CHUNKS, CHUNK_FRAMES,
+           (double)(chunk_bytes * RING_CHUNKS) / (1024.0 * 1024.0));
     
-    tp->running = 1;
+    __atomic_store_n(&tp->running, 1, __ATOMIC_RELEASE);
     return tp;
 }
 
 void txacplay_close(txacplay_desc *tp) {
     if (!tp) return;
-    tp->running = 0;
+    __atomic_store_n(&tp->running, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&tp->stop_producer, 1, __ATOMIC_RELEASE);
+    JOIN_THREAD(tp->producer);
+
+    for (int i = 0; i < RING_CHUNKS; i++) free(tp->ring[i].data);
+    for (int i = 0; i < tp->header.channels; i++) free(tp->channel_buffers[i].data);
+    for (uint32_t r = 0; r < tp->cache_rows; r++) {
+        for (int i = 0; i < tp->header.channels; i++) free(tp->cache[r].channels[i].data);
+        free(tp->cache[r].channels);
+    }
+    free(tp->cache);
+    free(tp->cache_slot);
+    free(tp->blocks);
+    free(tp->row_buf);
+    free(tp->residuals);
     if (tp->pcm_data_14bit) free(tp->pcm_data_14bit);
+    unmap_file(&tp->map);
     if (tp->file) fclose(tp->file);
     free(tp);
 }
 
+// ============================================================================
+// MICRO-BENCHMARK (--bench): conversão 14-bit → float e custo do callback
+// ============================================================================
+#define BENCH_PERIOD 1024  // quadros por callback, como no dispositivo real
+
+void txacplay_bench(txacplay_desc *tp) {
+    int ch = tp->header.channels;
+    float *out = (float*)malloc((size_t)BENCH_PERIOD * ch * sizeof(float));
+    float *ref = (float*)malloc((size_t)BENCH_PERIOD * ch * sizeof(float));
+    if (!out || !ref) {
+        fprintf(stderr, "Error: Failed to allocate RAM for benchmark\n");
+        exit(1);
+    }
+
+    // 1) Kernels isolados sobre um chunk pronto do anel (sem tocar no anel)
+    const uint8_t *chunk = tp->ring[tp->ring_tail % RING_CHUNKS].data;
+    uint64_t n = (uint64_t)tp->ring[tp->ring_tail % RING_CHUNKS].frames * ch;
+    if (n > (uint64_t)BENCH_PERIOD * ch) n = (uint64_t)BENCH_PERIOD * ch;
+    if (n == 0) {
+        // Faixa vazia: o produtor nunca publica chunks, não há o que medir
+        printf("Nothing to benchmark: the track has no frames\n");
+        free(out);
+        free(ref);
+        return;
+    }
+    float cf = tp->conversion_factor;
+
+    unpack14_to_float_scalar(chunk, 1, ref, n - 1, cf);
+    unpack14_to_float(chunk, 1, out, n - 1, cf);
+    if (memcmp(ref, out, (n - 1) * sizeof(float)) != 0)
+        printf("WARNING: AVX2 and scalar conversion disagree!\n");
+
+    int reps = 2000;
+    double t0 = now_seconds();
+    for (int r = 0; r < reps; r++) unpack14_to_float_scalar(chunk, 0, out, n, cf);
+    double t_scalar = now_seconds() - t0;
+    t0 = now_seconds();
+    for (int r = 0; r < reps; r++) unpack14_to_float(chunk, 0, out, n, cf);
+    double t_simd = now_seconds() - t0;
+
+    double frames = (double)reps * (double)(n / ch);
+    printf("\nunpack14 -> float, scalar: %.2f ns/frame\n", t_scalar * 1e9 / frames);
+    printf("unpack14 -> float, AVX2:   %.2f ns/frame (%.1fx)\n",
+           t_simd * 1e9 / frames, t_scalar / t_simd);
+
+    // 2) Callback completo consumindo o anel; só o tempo dentro do callback conta
+        ma_device dev;
+        memset(&dev, 0, sizeof(dev));
+        dev.pUserData = tp;
+        dev.playback.channels = ch;
+    int calls = 0;
+    double total = 0.0, worst = 0.0;
+    uint64_t target = (uint64_t)tp->header.sample_rate * 20;  // ~20 s de áudio
+    for (uint64_t played = 0; played < target; played += BENCH_PERIOD) {
+        // Espera o produtor ter um período inteiro à frente (fora da medição),
+        // ou o anel estar tão cheio quanto o produtor o deixa em regime normal
+        for (;;) {
+            uint32_t head  = __atomic_load_n(&tp->ring_head, __ATOMIC_ACQUIRE);
+            uint64_t ahead = 0;
+            for (uint32_t t = tp->ring_tail; t != head; t++)
+                ahead += tp->ring[t % RING_CHUNKS].frames;
+            if (ahead >= (uint64_t)BENCH_PERIOD + tp->chunk_pos) break;
+            if (head - tp->ring_tail >= RING_CHUNKS - SEEK_RESERVE) break;
+            THREAD_SLEEP_MS(1);
+        }
+        t0 = now_seconds();
+        audio_cb(&dev, out, NULL, BENCH_PERIOD);
+        double dt = now_seconds() - t0;
+        total += dt;
+        if (dt > worst) worst = dt;
+        calls++;
+    }
+    printf("\naudio_cb (%d-frame periods): %.2f ns/frame, worst call %.1f us, %u underruns\n",
+           BENCH_PERIOD, total * 1e9 / ((double)calls * BENCH_PERIOD), worst * 1e6,
+           __atomic_load_n(&tp->underruns, __ATOMIC_RELAXED));
+
+    free(out);
+    free(ref);
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
-        printf("Use: %s <file.txac>\n", argv[0]);
+        printf("Use: %s <file.txac> [--bench]\n", argv[0]);
         return 1;
     }
+    int bench = argc > 2 && strcmp(argv[2], "--bench") == 0;
     
     printf("Starting TXAC Player v0.3.1...\n");
     txacplay_desc *tp = txacplay_open(argv[1]);
@@ -631,6 +2155,12 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    if (bench) {
+        txacplay_bench(tp);
+        txacplay_close(tp);
+        return 0;
+    }
+
     // Configuração do dispositivo de áudio
     ma_device_config config = ma_device_config_init(ma_device_type_playback);
     config.playback.format   = ma_format_f32;   // Seu player trabalha com floats convertidos
@@ -663,6 +2193,9 @@ int main(int argc, char **argv) {
     
     printf("Playing...\n Press:\n [space] to pause\n [x] to go back 5s\n [c] to go forward 5s\n [q] to exit\n\n");
     
+    __atomic_store_n(&tp->ui_running, 1, __ATOMIC_RELEASE);
+    CREATE_THREAD(&tp->ui_thread, ui_thread_func, tp);
+
     int wants_to_quit = 0;
     while (!wants_to_quit) {
         char c = getch();
@@ -685,9 +2218,10 @@ int main(int argc, char **argv) {
                 wants_to_quit = 1;
                 break;
         }
-        
-        update_timer(tp);
     }
+
+    __atomic_store_n(&tp->ui_running, 0, __ATOMIC_RELEASE);
+    JOIN_THREAD(tp->ui_thread);
     
     ma_device_uninit(&device);
     txacplay_close(tp);